@@ -7,6 +7,7 @@
 #include "succinct/bit_vector.hpp"
 #include "util.hpp"
 #include "types.hpp"
+#include "cpu_features.hpp"
 
 #define M 1000000
 #define B 1000000000
@@ -207,6 +208,69 @@ void bit_sequence_perf_test(uint64_t n, uint64_t max_gap, uint64_t runs)
     next_geq_perf_test(reader, s, runs);
 }
 
+template<typename Enumerator>
+void decode_perf_test(Enumerator const& reader,
+                      uncompressed_sequence_type const& s,
+                      uint64_t runs)
+{
+    std::cout << "- decode ------------------\n"
+              << "[num. ints] [ns x int]"
+              << std::endl;
+
+    uint64_t n = reader.size();
+    std::vector<uint64_t> out(n);
+    auto start = clock_type::now();
+
+    for (uint64_t run = 0; run < runs; ++run) {
+        reader.decode(out.data(), n);
+        do_not_optimize_away(out[n - 1]);
+    }
+
+    auto end = clock_type::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << std::setw( 9) << n * runs
+              << std::setw(16) << std::fixed << std::setprecision(2)
+              << elapsed.count() / (n * runs)  * B
+              << "\n" << std::endl;
+    assert(std::equal(out.begin(), out.end(), s.begin()));
+    (void) s;
+}
+
+// compact_elias_fano is used directly for the partition metadata and the list
+// endpoints, so we benchmark it alone too: this wrapper gives its enumerator
+// the same interface of the partitioned sequences
+struct ef_enumerator : compact_elias_fano::enumerator
+{
+    ef_enumerator(succinct::bit_vector const& bv, uint64_t offset,
+                  uint64_t universe, uint64_t n,
+                  global_parameters const& params)
+        : compact_elias_fano::enumerator(bv, offset, universe, n, params)
+    {}
+
+    uint64_t docid() const {
+        return value().second;
+    }
+};
+
+void ef_perf_test(uint64_t n, uint64_t max_gap, uint64_t runs)
+{
+    auto s = random_sequence(n, max_gap);
+
+    global_parameters params;
+    succinct::bit_vector_builder bvb;
+    compact_elias_fano::write(
+        bvb, s.begin(), s.back() + 1, s.size(), params
+    );
+    succinct::bit_vector bv(&bvb);
+
+    ef_enumerator reader(bv, 0, s.back() + 1, n, params);
+
+    access_perf_test(reader, s, runs);
+    next_perf_test(reader, s, runs);
+    next_geq_perf_test(reader, s, runs);
+    decode_perf_test(reader, s, runs);
+}
+
 template<typename ByteSequenceType>
 void byte_sequence_perf_test(uint64_t n, uint64_t max_gap, uint64_t runs)
 {
@@ -240,6 +304,11 @@ int main (int argc, char** argv)
     std::cerr << "\"sequence_type\": \"" << type << "\", ";
     std::cerr << "\"n\": " << n << ", ";
     std::cerr << "\"max_gap\": " << max_gap << ", ";
+    std::cerr << "\"isa\": \"" << cpu_features::get().isa_name() << "\", ";
+    std::cerr << "\"select\": \""
+              << (cpu_features::get().bmi2 ? "bmi2" : "broadword") << "\", ";
+    std::cerr << "\"decode\": \""
+              << (cpu_features::get().avx2 ? "avx2" : "scalar") << "\", ";
 
     if (type == std::string("vb")) {
         byte_sequence_perf_test<vb_sequence>(n, max_gap, runs);
@@ -251,6 +320,8 @@ int main (int argc, char** argv)
         bit_sequence_perf_test<uniform_rb_sequence>(n, max_gap, runs);
     } else if (type == std::string("uniform_ef")) {
         bit_sequence_perf_test<uniform_ef_sequence>(n, max_gap, runs);
+    } else if (type == std::string("ef")) {
+        ef_perf_test(n, max_gap, runs);
     } else {
         logger() << "ERROR: Unknown type " << type << std::endl;
     }
@@ -1,5 +1,6 @@
 #include "succinct/mapper.hpp"
 
+#include "index_file.hpp"
 #include "types.hpp"
 #include "util.hpp"
 
@@ -36,8 +37,10 @@ void perftest(IndexType& index, std::string const& type)
 
         auto start = clock_type::now();
         size_t postings = 0;
+        std::vector<uint64_t> scan_metadata;
         for (auto i: long_lists) {
             auto reader = index[i];
+            open_scan(reader, scan_metadata);
             size_t size = reader.size();
             for (size_t i = 0; i < size; ++i) {
                 reader.next();
@@ -61,12 +64,23 @@ void perftest(IndexType& index, std::string const& type)
 }
 
 template<typename IndexType>
-void perftest(const char* index_filename, std::string const& type)
+void perftest(const char* index_filename, std::string const& type,
+              bool hugepages)
 {
     logger() << "Loading index from " << index_filename << std::endl;
     IndexType index;
-    boost::iostreams::mapped_file_source m(index_filename);
-    succinct::mapper::map(index, m, succinct::mapper::map_flags::warmup);
+    configuration conf(64);
+    index_file file(index_filename, hugepages, conf.worker_threads);
+    map_index(index, file.data(), file.size());
+    logger() << "Index loaded in " << file.load_time() << " [sec] ("
+             << file.mode() << ")" << std::endl;
+    double warmup_time = file.warmup(conf.worker_threads);
+    logger() << "Index warmed up in " << warmup_time << " [sec] with "
+             << conf.worker_threads << " threads" << std::endl;
+    std::cout << type << "\t" << "load_" << file.mode()
+              << "\t" << file.load_time() << std::endl;
+    std::cout << type << "\t" << "warmup"
+              << "\t" << warmup_time << std::endl;
     perftest<IndexType>(index, type);
 }
 
@@ -74,21 +88,22 @@ int main(int argc, const char** argv) {
 
     if (argc < 3) {
         std::cerr << "Usage: " << argv[0] << ":\n"
-                  << "\t <index_type> <index_filename>"
+                  << "\t <index_type> <index_filename> [--hugepages]"
                   << std::endl;
         return 1;
     }
 
     std::string index_type = argv[1];
     const char* index_filename = argv[2];
+    bool hugepages = argc > 3 and std::string(argv[3]) == "--hugepages";
 
     if (false) {
 #define LOOP_BODY(R, DATA, T)                               \
         } else if (index_type == BOOST_PP_STRINGIZE(T)) {   \
             perftest<BOOST_PP_CAT(T, _index)>               \
-                (index_filename, index_type);               \
+                (index_filename, index_type, hugepages);    \
 
-        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_INDEX_TYPES);
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_ALL_INDEX_TYPES);
 #undef LOOP_BODY
     } else {
         logger() << "ERROR: Unknown index type '" << index_type << "'." << std::endl;
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+
+#include "configuration.hpp"
+#include "queries.hpp"
+#include "types.hpp"
+#include "updatable_index.hpp"
+#include "util.hpp"
+
+using namespace pvb;
+
+typedef updatable_index<opt_vb_index> index_type;
+typedef std::vector<std::pair<uint32_t, uint32_t>> document;
+
+// turns the inverted collection back into documents, to replay their
+// insertion in docid order
+std::vector<document> read_documents(binary_freq_collection const& input) {
+    std::vector<document> docs(input.num_docs());
+    uint32_t term = 0;
+    for (auto const& plist : input) {
+        for (size_t i = 0; i < plist.docs.size(); ++i) {
+            docs[plist.docs.begin()[i]].emplace_back(term,
+                                                     plist.freqs.begin()[i]);
+        }
+        ++term;
+    }
+    return docs;
+}
+
+template <typename Snapshot>
+double query_time(Snapshot const& index,
+                  std::vector<term_id_vec> const& queries,
+                  std::vector<uint64_t>& results) {
+    static const size_t runs = 3;
+    results.clear();
+    for (auto const& q : queries) {  // first run is not timed
+        results.push_back(and_query()(index, q));
+    }
+    auto tick = get_time_usecs();
+    for (size_t run = 0; run < runs; ++run) {
+        for (auto const& q : queries) {
+            uint64_t result = and_query()(index, q);
+            do_not_optimize_away(result);
+        }
+    }
+    return (get_time_usecs() - tick) / (runs * queries.size());
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage " << argv[0] << ":\n\t"
+                  << "<collection_basename> <query_filename> "
+                     "[--segment-docs n] [--merge-factor f] "
+                     "[--merge-threads t]"
+                  << std::endl;
+        return 1;
+    }
+
+    const char* collection_basename = argv[1];
+    const char* query_filename = argv[2];
+    index_type::parameters params;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--segment-docs") {
+            params.segment_docs = std::stoull(argv[++i]);
+        } else if (arg == "--merge-factor") {
+            params.merge_factor = std::stoull(argv[++i]);
+        } else if (arg == "--merge-threads") {
+            params.merge_threads = std::stoull(argv[++i]);
+        } else {
+            logger() << "ERROR: Unknown option '" << arg << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    configuration conf(64);
+    binary_freq_collection input(collection_basename);
+    logger() << "Reading documents" << std::endl;
+    auto docs = read_documents(input);
+
+    std::vector<term_id_vec> queries;
+    {
+        std::ifstream is(query_filename);
+        term_id_vec q;
+        while (read_query(q, is)) {
+            queries.push_back(q);
+        }
+    }
+
+    logger() << "Adding " << docs.size() << " documents" << std::endl;
+    std::vector<double> latencies;
+    latencies.reserve(docs.size());
+    double tick = get_time_usecs();
+    index_type index(conf, params);
+    for (auto const& doc : docs) {
+        auto doc_tick = get_time_usecs();
+        index.add_document(doc);
+        latencies.push_back(get_time_usecs() - doc_tick);
+    }
+    index.flush();
+    double ingest_secs = (get_time_usecs() - tick) / 1000000;
+    index.wait_merges();
+    double total_secs = (get_time_usecs() - tick) / 1000000;
+
+    std::sort(latencies.begin(), latencies.end());
+    double avg_latency =
+        std::accumulate(latencies.begin(), latencies.end(), double(0)) /
+        latencies.size();
+    auto stats = index.stats();
+    double merge_throughput = stats.merged_postings / stats.merge_time;
+    logger() << "Ingested " << docs.size() << " documents in " << ingest_secs
+             << " [sec], " << stats.flushes << " flushes, " << stats.merges
+             << " merges" << std::endl;
+    stats_line()("segment_docs", params.segment_docs)(
+        "merge_factor", params.merge_factor)(
+        "merge_threads", params.merge_threads)("docs", docs.size())(
+        "ingest_time", ingest_secs)("total_time", total_secs)(
+        "avg_ingest_latency", avg_latency)(
+        "p99_ingest_latency", latencies[latencies.size() * 99 / 100])(
+        "max_ingest_latency", latencies.back())("flushes", stats.flushes)(
+        "merges", stats.merges)("merged_postings", stats.merged_postings)(
+        "merge_postings_per_sec", merge_throughput);
+
+    // the same documents in a single segment, as a baseline
+    index_type::parameters single_params;
+    single_params.segment_docs = docs.size();
+    single_params.merge_threads = 0;
+    index_type single(conf, single_params);
+    for (auto const& doc : docs) {
+        single.add_document(doc);
+    }
+    single.flush();
+
+    std::vector<uint64_t> results, expected;
+    auto snapshot = index.get_snapshot();
+    double avg = query_time(snapshot, queries, results);
+    double single_avg = query_time(single.get_snapshot(), queries, expected);
+    if (results != expected) {
+        logger() << "ERROR: results differ from the single segment index"
+                 << std::endl;
+        return 1;
+    }
+
+    size_t segments = snapshot.num_segments();
+    double overhead =
+        segments > 1 ? (avg - single_avg) / (segments - 1) : 0;
+    logger() << segments << " segments: " << avg << " [us] per query, "
+             << single_avg << " [us] with a single segment" << std::endl;
+    stats_line()("query", "and")("segments", segments)("avg", avg)(
+        "single_segment_avg", single_avg)("overhead_per_segment", overhead);
+}
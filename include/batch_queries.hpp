@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "queries.hpp"
+
+namespace pvb {
+
+// Intersects the lists of a batch of queries together, so that each distinct
+// term of the batch has a single enumerator, moved forward once over its list
+// on behalf of all the queries containing it.
+//
+// The docids are processed in windows of window_docs docids. In each window,
+// the shortest list of every query is read into a buffer first; then the
+// other lists of the queries whose shortest list has postings in the window
+// are read, each once however many queries contain it, and every such query
+// intersects its buffers. The windows with no postings in the shortest lists
+// are skipped, so the longer lists are only read where some query needs them.
+//
+// The queries sharing no term with each other are split into groups, each
+// going through the windows on its own.
+template <typename Index>
+class batch_intersection {
+public:
+    typedef typename Index::document_enumerator enum_type;
+
+    // queries must not contain duplicate terms; the frequencies are read only
+    // if with_freqs
+    batch_intersection(Index& index, std::vector<term_id_vec> const& queries,
+                       bool with_freqs, uint64_t window_docs = 1 << 12)
+        : m_num_docs(index.num_docs())
+        , m_with_freqs(with_freqs)
+        , m_window_docs(window_docs)
+        , m_query_lists(queries.size()) {
+        std::unordered_map<term_id_type, size_t> lists;
+        for (size_t q = 0; q < queries.size(); ++q) {
+            for (auto term : queries[q]) {
+                auto it = lists.find(term);
+                if (it == lists.end()) {
+                    it = lists.emplace(term, m_enums.size()).first;
+                    m_enums.push_back(index[term]);
+                    m_terms.push_back(term);
+                }
+                m_query_lists[q].push_back(it->second);
+            }
+            // increasing frequency
+            std::sort(m_query_lists[q].begin(), m_query_lists[q].end(),
+                      [&](size_t lhs, size_t rhs) {
+                          return m_enums[lhs].size() < m_enums[rhs].size();
+                      });
+        }
+        m_buffers.resize(m_enums.size());
+        group_queries();
+    }
+
+    // lists of query q, in increasing size
+    std::vector<size_t> const& query_lists(size_t q) const {
+        return m_query_lists[q];
+    }
+
+    term_id_type term(size_t list) const {
+        return m_terms[list];
+    }
+
+    uint64_t list_size(size_t list) const {
+        return m_enums[list].size();
+    }
+
+    // frequency of the posting at position pos of the current window of list
+    uint64_t freq(size_t list, size_t pos) const {
+        return m_buffers[list].freqs[pos];
+    }
+
+    // number of distinct lists, opened once each
+    uint64_t lists() const {
+        return m_enums.size();
+    }
+
+    uint64_t groups() const {
+        return m_groups.size();
+    }
+
+    // calls on_match(q, docid, positions) for each document docid in all
+    // the lists of query q, where positions[i] is the position of docid in
+    // the window of the i-th list of the query (see freq)
+    template <typename OnMatch>
+    void run(OnMatch on_match) {
+        std::vector<size_t> positions;
+        for (auto const& group : m_groups) {
+            uint64_t window = 0;
+            while (true) {
+                // skip to the first window with a posting in a shortest list
+                uint64_t next_docid = m_num_docs;
+                for (auto q : group) {
+                    auto& lead = m_enums[m_query_lists[q][0]];
+                    if (lead.docid() < window) lead.next_geq(window);
+                    next_docid = std::min<uint64_t>(next_docid, lead.docid());
+                }
+                if (next_docid >= m_num_docs) break;
+                uint64_t begin = next_docid - next_docid % m_window_docs;
+                uint64_t end = std::min(begin + m_window_docs, m_num_docs);
+
+                for (auto q : group) {
+                    auto const& lists = m_query_lists[q];
+                    read_window(lists[0], begin, end);
+                    if (m_buffers[lists[0]].docs.empty()) continue;
+                    for (size_t i = 1; i < lists.size(); ++i) {
+                        read_window(lists[i], begin, end);
+                    }
+                    positions.assign(lists.size(), 0);
+                    intersect(q, positions, on_match);
+                }
+                window = end;
+            }
+        }
+    }
+
+private:
+    struct window_buffer {
+        window_buffer() : begin(uint64_t(-1)) {}
+
+        uint64_t begin;  // of the window read
+        std::vector<uint32_t> docs;
+        std::vector<uint32_t> freqs;
+    };
+
+    void read_window(size_t list, uint64_t begin, uint64_t end) {
+        auto& buffer = m_buffers[list];
+        if (buffer.begin == begin) return;
+        buffer.begin = begin;
+        buffer.docs.clear();
+        buffer.freqs.clear();
+        auto& e = m_enums[list];
+        if (e.docid() < begin) e.next_geq(begin);
+        for (; e.docid() < end; e.next()) {
+            buffer.docs.push_back(e.docid());
+            if (m_with_freqs) buffer.freqs.push_back(e.freq());
+        }
+    }
+
+    // first position from pos in docs with a docid not less than
+    // lower_bound, galloping and then binary searching the last step
+    static size_t gallop(std::vector<uint32_t> const& docs, size_t pos,
+                         uint64_t lower_bound) {
+        size_t step = 1;
+        while (pos + step < docs.size() and docs[pos + step] < lower_bound) {
+            pos += step;
+            step *= 2;
+        }
+        size_t end = std::min(pos + step, docs.size());
+        return std::lower_bound(docs.begin() + pos, docs.begin() + end,
+                                lower_bound) -
+               docs.begin();
+    }
+
+    // the intersection of the buffers of query q, as in and_query
+    template <typename OnMatch>
+    void intersect(size_t q, std::vector<size_t>& positions,
+                   OnMatch& on_match) {
+        auto const& lists = m_query_lists[q];
+        auto const& lead = m_buffers[lists[0]].docs;
+        uint64_t candidate = lead[0];
+        while (true) {
+            size_t i = 1;
+            for (; i < lists.size(); ++i) {
+                auto const& docs = m_buffers[lists[i]].docs;
+                positions[i] = gallop(docs, positions[i], candidate);
+                if (positions[i] == docs.size()) return;
+                if (docs[positions[i]] != candidate) break;
+            }
+
+            if (i == lists.size()) {
+                on_match(q, candidate, positions);
+                positions[0] += 1;
+            } else {
+                positions[0] = gallop(lead, positions[0],
+                                      m_buffers[lists[i]].docs[positions[i]]);
+            }
+            if (positions[0] == lead.size()) return;
+            candidate = lead[positions[0]];
+        }
+    }
+
+    // connected components of the queries sharing a list
+    void group_queries() {
+        std::vector<size_t> parent(m_query_lists.size());
+        std::iota(parent.begin(), parent.end(), 0);
+        auto root = [&](size_t q) {
+            while (parent[q] != q) {
+                q = parent[q] = parent[parent[q]];
+            }
+            return q;
+        };
+        std::vector<size_t> list_query(m_enums.size(), size_t(-1));
+        for (size_t q = 0; q < m_query_lists.size(); ++q) {
+            for (auto l : m_query_lists[q]) {
+                if (list_query[l] == size_t(-1)) {
+                    list_query[l] = q;
+                } else {
+                    parent[root(q)] = root(list_query[l]);
+                }
+            }
+        }
+        std::unordered_map<size_t, size_t> group_ids;
+        for (size_t q = 0; q < m_query_lists.size(); ++q) {
+            if (m_query_lists[q].empty()) continue;
+            auto it = group_ids.emplace(root(q), m_groups.size()).first;
+            if (it->second == m_groups.size()) {
+                m_groups.emplace_back();
+            }
+            m_groups[it->second].push_back(q);
+        }
+    }
+
+    uint64_t m_num_docs;
+    bool m_with_freqs;
+    uint64_t m_window_docs;
+    std::vector<enum_type> m_enums;
+    std::vector<term_id_type> m_terms;
+    std::vector<window_buffer> m_buffers;
+    std::vector<std::vector<size_t>> m_query_lists;
+    std::vector<std::vector<size_t>> m_groups;
+};
+
+// and_query over a batch of queries, with the results in the order of the
+// queries
+struct batch_and_query {
+    template <typename Index>
+    std::vector<uint64_t> operator()(Index& index,
+                                     std::vector<term_id_vec> queries) const {
+        for (auto& terms : queries) {
+            remove_duplicate_terms(terms);
+        }
+        batch_intersection<Index> batch(index, queries, false);
+        std::vector<uint64_t> results(queries.size(), 0);
+        batch.run([&](size_t q, uint64_t, std::vector<size_t> const&) {
+            results[q] += 1;
+        });
+        return results;
+    }
+};
+
+// ranked_and_query over a batch of queries, with the top-k lists in the order
+// of the queries
+struct batch_ranked_and_query {
+    typedef bm25 scorer_type;
+    typedef std::vector<scored_docid_type> scored_data_type;
+
+    batch_ranked_and_query(wand_data<scorer_type> const& wdata, uint64_t k)
+        : m_wdata(&wdata), m_k(k) {}
+
+    template <typename Index>
+    std::vector<scored_data_type> operator()(
+        Index& index, std::vector<term_id_vec> const& queries) const {
+        std::vector<term_freq_vec> query_term_freqs;
+        std::vector<term_id_vec> terms(queries.size());
+        for (size_t q = 0; q < queries.size(); ++q) {
+            query_term_freqs.push_back(query_freqs(queries[q]));
+            for (auto const& t : query_term_freqs.back()) {
+                terms[q].push_back(t.first);
+            }
+        }
+        batch_intersection<Index> batch(index, terms, true);
+
+        // weights in the order of the lists of each query
+        uint64_t num_docs = index.num_docs();
+        std::vector<std::vector<float>> q_weights(queries.size());
+        for (size_t q = 0; q < queries.size(); ++q) {
+            for (auto l : batch.query_lists(q)) {
+                auto it = std::lower_bound(
+                    query_term_freqs[q].begin(), query_term_freqs[q].end(),
+                    term_freq_pair(batch.term(l), 0));
+                q_weights[q].push_back(scorer_type::query_term_weight(
+                    it->second, batch.list_size(l), num_docs));
+            }
+        }
+
+        std::vector<topk_queue<scored_data_type>> topks(
+            queries.size(), topk_queue<scored_data_type>(m_k));
+        batch.run([&](size_t q, uint64_t docid,
+                      std::vector<size_t> const& positions) {
+            float denominator = m_wdata->len_denominator(docid);
+            auto const& lists = batch.query_lists(q);
+            float score = 0;
+            for (size_t i = 0; i < lists.size(); ++i) {
+                score += q_weights[q][i] *
+                         scorer_type::doc_term_weight_denominator(
+                             batch.freq(lists[i], positions[i]), denominator);
+            }
+            topks[q].insert(score, docid);
+        });
+
+        std::vector<scored_data_type> results;
+        for (auto& topk : topks) {
+            topk.finalize();
+            results.push_back(topk.topk());
+        }
+        return results;
+    }
+
+private:
+    wand_data<scorer_type> const* m_wdata;
+    uint64_t m_k;
+};
+
+}  // namespace pvb
@@ -59,6 +59,19 @@ public:
         return succinct::bit_vector::enumerator(m_bitvectors, endpoint);
     }
 
+    // bits [begin, end) of the i-th bitvector
+    std::pair<uint64_t, uint64_t> range(global_parameters const& params,
+                                        size_t i) const {
+        assert(i < size());
+        compact_elias_fano::enumerator endpoints(
+            m_endpoints, 0, m_bitvectors.size(), m_size, params);
+
+        uint64_t begin = endpoints.move(i).second;
+        uint64_t end = i + 1 < size() ? endpoints.move(i + 1).second
+                                      : m_bitvectors.size();
+        return {begin, end};
+    }
+
     void swap(bitvector_collection& other) {
         std::swap(m_size, other.m_size);
         m_endpoints.swap(other.m_endpoints);
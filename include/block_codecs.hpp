@@ -6,6 +6,30 @@
 #include "MaskedVByte/include/varintencode.h"
 #include "MaskedVByte/include/varintdecode.h"
 
+#ifdef DS2I_ISA_DISPATCH
+// The external SIMD decoders are also compiled for the higher ISA levels,
+// with their entry points renamed (see external/CMakeLists.txt)
+extern "C" {
+size_t masked_vbyte_decode_avx2(const uint8_t* in, uint32_t* out,
+                                uint64_t length);
+size_t masked_vbyte_decode_avx512(const uint8_t* in, uint32_t* out,
+                                  uint64_t length);
+size_t streamvbyte_decode_avx2(const uint8_t* in, uint32_t* out,
+                               uint32_t length);
+size_t streamvbyte_decode_avx512(const uint8_t* in, uint32_t* out,
+                                 uint32_t length);
+}
+#define DS2I_ISA_VARIANTS(fn) pvb::isa_dispatch(fn, fn##_avx2, fn##_avx512)
+#else
+// built with -march=native, there is only one version of each decoder
+#define DS2I_ISA_VARIANTS(fn) (fn)
+#endif
+
+#define DS2I_TARGET_AVX2 __attribute__((target("avx2,bmi,bmi2,popcnt")))
+#define DS2I_TARGET_AVX512                                     \
+    __attribute__((target("avx512f,avx512bw,avx512dq,avx512vl," \
+                          "avx2,bmi,bmi2,popcnt")))
+
 #include "global_parameters.hpp"
 #include "succinct/bit_vector.hpp"
 
@@ -16,9 +40,25 @@
 #include "interpolative_coding.hpp"
 #include "util.hpp"
 #include "typedefs.hpp"
+#include "cpu_features.hpp"
 
 namespace pvb {
 
+// Returns the version of a decoder compiled for the ISA level selected at
+// startup, so that the same binary runs on every machine and still uses the
+// widest instructions available.
+template <typename Function>
+Function isa_dispatch(Function sse41, Function avx2, Function avx512) {
+    switch (cpu_features::get().isa) {
+        case cpu_features::isa_avx512:
+            return avx512;
+        case cpu_features::isa_avx2:
+            return avx2;
+        default:
+            return sse41;
+    }
+}
+
 // workaround: VariableByte::decodeArray needs the buffer size, while we
 // only know the number of values. It also pads to 32 bits. We need to
 // rewrite
@@ -107,8 +147,12 @@ public:
     }
 };
 
+// The block codecs encode up to BlockSize values at a time, which also sets
+// the skip granularity and the decode buffer size of the sequences using them
+// (block_sequence, block_posting_list).
+template <uint64_t BlockSize = constants::block_size>
 struct interpolative_block {
-    static const uint64_t block_size = constants::block_size;
+    static const uint64_t block_size = BlockSize;
 
     static void encode(uint32_t const* in, uint32_t sum_of_values, size_t n,
                        std::vector<uint8_t>& out) {
@@ -156,8 +200,9 @@ struct interpolative_block {
     }
 };
 
+template <uint64_t BlockSize = constants::block_size>
 struct varintg8iu_block {
-    static const uint64_t block_size = constants::block_size;
+    static const uint64_t block_size = BlockSize;
 
     struct codec_type : VarIntG8IU {
         // rewritten version of decodeBlock optimized for when the output
@@ -194,7 +239,7 @@ struct varintg8iu_block {
         assert(n <= block_size);
 
         if (n < 8) {
-            interpolative_block::encode(in, sum_of_values, n, out);
+            interpolative_block<BlockSize>::encode(in, sum_of_values, n, out);
             return;
         }
 
@@ -212,16 +257,27 @@ struct varintg8iu_block {
         out.insert(out.end(), buf.data(), buf.data() + out_len);
     }
 
-    // we only allow varint to be inlined (others have DS2I_NOILINE)
+    // the group loop is selected at startup for the ISA level, see
+    // isa_dispatch
     static uint8_t const* decode(uint8_t const* in, uint32_t* out,
                                  uint32_t sum_of_values, size_t n) {
-        static codec_type varint_codec;  // decodeBlock is thread-safe
         assert(n <= block_size);
 
         if (DS2I_UNLIKELY(n < 8)) {
-            return interpolative_block::decode(in, out, sum_of_values, n);
+            return interpolative_block<BlockSize>::decode(in, out,
+                                                          sum_of_values, n);
         }
 
+        typedef uint8_t const* (*decode_fn)(uint8_t const*, uint32_t*, size_t);
+        static const decode_fn decode_groups = isa_dispatch<decode_fn>(
+            decode_groups_sse41, decode_groups_avx2, decode_groups_avx512);
+        return decode_groups(in, out, n);
+    }
+
+private:
+    static DS2I_ALWAYSINLINE uint8_t const* decode_groups_impl(
+        uint8_t const* in, uint32_t* out, size_t n) {
+        static codec_type varint_codec;  // decodeBlock is thread-safe
         size_t out_len = 0;
         uint8_t const* src = in;
         uint32_t* dst = out;
@@ -241,15 +297,31 @@ struct varintg8iu_block {
         assert(out_len == n);
         return src;
     }
+
+    static uint8_t const* decode_groups_sse41(uint8_t const* in, uint32_t* out,
+                                              size_t n) {
+        return decode_groups_impl(in, out, n);
+    }
+
+    DS2I_TARGET_AVX2 static uint8_t const* decode_groups_avx2(
+        uint8_t const* in, uint32_t* out, size_t n) {
+        return decode_groups_impl(in, out, n);
+    }
+
+    DS2I_TARGET_AVX512 static uint8_t const* decode_groups_avx512(
+        uint8_t const* in, uint32_t* out, size_t n) {
+        return decode_groups_impl(in, out, n);
+    }
 };
 
+template <uint64_t BlockSize = constants::block_size>
 struct streamvbyte_block {
-    static const uint64_t block_size = constants::block_size;
+    static const uint64_t block_size = BlockSize;
     static void encode(uint32_t const* in, uint32_t sum_of_values, size_t n,
                        std::vector<uint8_t>& out) {
         assert(n <= block_size);
         if (n < block_size) {
-            interpolative_block::encode(in, sum_of_values, n, out);
+            interpolative_block<BlockSize>::encode(in, sum_of_values, n, out);
             return;
         }
         uint32_t* src = const_cast<uint32_t*>(in);
@@ -261,15 +333,19 @@ struct streamvbyte_block {
                                  uint32_t sum_of_values, size_t n) {
         assert(n <= block_size);
         if (DS2I_UNLIKELY(n < block_size)) {
-            return interpolative_block::decode(in, out, sum_of_values, n);
+            return interpolative_block<BlockSize>::decode(in, out,
+                                                          sum_of_values, n);
         }
-        auto read = streamvbyte_decode(in, out, n);
+        static const auto streamvbyte_decode_fn =
+            DS2I_ISA_VARIANTS(streamvbyte_decode);
+        auto read = streamvbyte_decode_fn(in, out, n);
         return in + read;
     }
 };
 
+template <uint64_t BlockSize = constants::block_size>
 struct maskedvbyte_block {
-    static const uint64_t block_size = constants::block_size;
+    static const uint64_t block_size = BlockSize;
     static const int type = 0;
 
     static inline uint64_t posting_cost(posting_type x, uint64_t base) {
@@ -332,20 +408,113 @@ struct maskedvbyte_block {
     static uint8_t const* decode(uint8_t const* in, uint32_t* out,
                                  uint32_t sum_of_values, size_t n) {
         (void)sum_of_values;
-        auto read = masked_vbyte_decode(in, out, n);
+        static const auto masked_vbyte_decode_fn =
+            DS2I_ISA_VARIANTS(masked_vbyte_decode);
+        auto read = masked_vbyte_decode_fn(in, out, n);
         return in + read;
     }
 };
 
+// StreamVByte variant spending 0, 1, 2 or 4 bytes per value (the 2-bit codes
+// of the control bytes), so that zeros cost only their code. Used for the
+// frequencies minus one, see partitioned_freqs_sequence.
+template <uint64_t BlockSize = constants::block_size>
+struct streamvbyte_0124_block {
+    static const uint64_t block_size = BlockSize;
+
+    static void encode(uint32_t const* in, uint32_t sum_of_values, size_t n,
+                       std::vector<uint8_t>& out) {
+        (void)sum_of_values;
+        assert(n <= block_size);
+        size_t control = out.size();
+        out.resize(control + (n + 3) / 4, 0);
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t x = in[i];
+            uint8_t code = x < (1U << 8) ? (x != 0) : x < (1U << 16) ? 2 : 3;
+            out[control + i / 4] |= code << (2 * (i % 4));
+            for (uint8_t b = 0; b < code_length(code); ++b) {
+                out.push_back(uint8_t(x >> (8 * b)));
+            }
+        }
+    }
+
+    // out must have room for n rounded up to a multiple of 4 values
+    static uint8_t const* decode(uint8_t const* in, uint32_t* out,
+                                 uint32_t sum_of_values, size_t n) {
+        (void)sum_of_values;
+        assert(n <= block_size);
+        static const tables t;
+        uint8_t const* control = in;
+        size_t control_bytes = (n + 3) / 4;
+        uint8_t const* data = in + control_bytes;
+        uint8_t const* data_end = data;
+        for (size_t i = 0; i < control_bytes; ++i) {
+            data_end += t.length[control[i]];
+        }
+
+        // the shuffles read 16 bytes, the tail is decoded one value at a time
+        size_t i = 0;
+        for (; i < control_bytes and data + 16 <= data_end; ++i) {
+            uint8_t c = control[i];
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * i),
+                             _mm_shuffle_epi8(v, t.shuffle[c]));
+            data += t.length[c];
+        }
+        for (; i < control_bytes; ++i) {
+            uint8_t c = control[i];
+            for (size_t j = 0; j < 4; ++j) {
+                uint8_t len = code_length((c >> (2 * j)) & 3);
+                uint32_t x = 0;
+                for (uint8_t b = 0; b < len; ++b) {
+                    x |= uint32_t(data[b]) << (8 * b);
+                }
+                out[4 * i + j] = x;
+                data += len;
+            }
+        }
+        assert(data == data_end);
+        return data;
+    }
+
+private:
+    static uint8_t code_length(uint8_t code) {
+        return code == 3 ? 4 : code;
+    }
+
+    struct tables {
+        tables() {
+            for (int c = 0; c < 256; ++c) {
+                uint8_t mask[16];
+                uint8_t src = 0;
+                length[c] = 0;
+                for (int j = 0; j < 4; ++j) {
+                    uint8_t len = code_length((c >> (2 * j)) & 3);
+                    for (int b = 0; b < 4; ++b) {
+                        mask[4 * j + b] = b < len ? src++ : 0x80;  // zero
+                    }
+                    length[c] += len;
+                }
+                shuffle[c] =
+                    _mm_loadu_si128(reinterpret_cast<__m128i const*>(mask));
+            }
+        }
+
+        uint8_t length[256];
+        __m128i shuffle[256];
+    };
+};
+
+template <uint64_t BlockSize = constants::block_size>
 struct varintgb_block {
-    static const uint64_t block_size = constants::block_size;
+    static const uint64_t block_size = BlockSize;
 
     static void encode(uint32_t const* in, uint32_t sum_of_values, size_t n,
                        std::vector<uint8_t>& out) {
         VarIntGB<false> varintgb_codec;
         assert(n <= block_size);
         if (n < block_size) {
-            interpolative_block::encode(in, sum_of_values, n, out);
+            interpolative_block<BlockSize>::encode(in, sum_of_values, n, out);
             return;
         }
         std::vector<uint8_t> buf(2 * n * sizeof(uint32_t));
@@ -358,7 +527,8 @@ struct varintgb_block {
         VarIntGB<false> varintgb_codec;
         assert(n <= block_size);
         if (DS2I_UNLIKELY(n < block_size)) {
-            return interpolative_block::decode(in, out, sum_of_values, n);
+            return interpolative_block<BlockSize>::decode(in, out,
+                                                          sum_of_values, n);
         }
         auto read = varintgb_codec.decodeArray(in, n, out);
         return read + in;
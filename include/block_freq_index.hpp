@@ -6,6 +6,7 @@
 #include "configuration.hpp"
 #include "compact_elias_fano.hpp"
 #include "block_posting_list.hpp"
+#include "term_directory.hpp"
 
 namespace pvb {
 
@@ -86,6 +87,12 @@ public:
 
     document_enumerator operator[](size_t i) const {
         assert(i < size());
+        if (!m_directory.empty()) {
+            auto const& header = m_directory[i];
+            return document_enumerator(m_lists.data() + header.offset,
+                                       header.n, num_docs(), i);
+        }
+
         compact_elias_fano::enumerator endpoints(m_endpoints, 0, m_lists.size(),
                                                  m_size, m_params);
 
@@ -93,8 +100,37 @@ public:
         return document_enumerator(m_lists.data() + endpoint, num_docs(), i);
     }
 
+    // fills the term directory, after which opening a list reads only its
+    // entry instead of moving the endpoints and decoding the list size
+    void build_term_directory() {
+        compact_elias_fano::enumerator endpoints(m_endpoints, 0, m_lists.size(),
+                                                 m_size, m_params);
+        std::vector<list_header> entries(size());
+        for (size_t i = 0; i < size(); ++i) {
+            uint8_t const* list = m_lists.data() + endpoints.move(i).second;
+            uint32_t n;
+            uint8_t const* blocks = TightVariableByte::decode(list, &n, 1);
+            entries[i].offset = blocks - m_lists.data();
+            entries[i].n = n;
+        }
+        m_directory.build(entries);
+    }
+
+    uint64_t term_directory_size() const {
+        return m_directory.size() * sizeof(list_header);
+    }
+
     void warmup(size_t i) const {
         assert(i < size());
+        if (!m_directory.empty()) {
+            // the size before the blocks is not read when opening the list
+            auto begin = m_directory[i].offset;
+            auto end = i + 1 != size() ? m_directory[i + 1].offset
+                                       : m_lists.size();
+            warmup_range(m_lists.data() + begin, end - begin);
+            return;
+        }
+
         compact_elias_fano::enumerator endpoints(m_endpoints, 0, m_lists.size(),
                                                  m_size, m_params);
 
@@ -104,11 +140,7 @@ public:
             end = endpoints.move(i + 1).second;
         }
 
-        volatile uint32_t tmp;
-        for (; begin != end; ++begin) {
-            tmp = m_lists[begin];
-        }
-        (void)tmp;
+        warmup_range(m_lists.data() + begin, end - begin);
     }
 
     global_parameters& params() {
@@ -120,6 +152,7 @@ public:
         std::swap(m_size, other.m_size);
         m_endpoints.swap(other.m_endpoints);
         m_lists.swap(other.m_lists);
+        m_directory.swap(other.m_directory);
     }
 
     template <typename Visitor>
@@ -128,11 +161,24 @@ public:
             m_endpoints, "m_endpoints")(m_lists, "m_lists");
     }
 
+private:
+    struct list_header {
+        uint64_t offset;  // of the blocks, past the size of the list
+        uint64_t n;
+    };
+
+public:
+    // not mapped with the rest of the index (see term_directory)
+    term_directory<list_header>& directory() {
+        return m_directory;
+    }
+
 private:
     global_parameters m_params;
     size_t m_size;
     size_t m_num_docs;
     succinct::bit_vector m_endpoints;
     succinct::mapper::mappable_vector<uint8_t> m_lists;
+    term_directory<list_header> m_directory;
 };
 }  // namespace pvb
@@ -94,14 +94,22 @@ struct block_posting_list {
             , m_block_endpoints(m_block_maxs + 4 * m_blocks)
             , m_blocks_data(m_block_endpoints + 4 * (m_blocks - 1))
             , m_universe(universe) {
-            if (Profile) {
-                // std::cout << "OPEN\t" << m_term_id << "\t" << m_blocks <<
-                // "\n";
-                m_block_profile = block_profiler::open_list(term_id, m_blocks);
-            }
-            m_docs_buf.resize(BlockCodec::block_size);
-            m_freqs_buf.resize(BlockCodec::block_size);
-            reset();
+            open(term_id);
+        }
+
+        // for a list whose size n is known from elsewhere (see the term
+        // directory of block_freq_index): blocks points past the size written
+        // at the beginning of the list, which is not decoded
+        document_enumerator(uint8_t const* blocks, uint64_t n,
+                            uint64_t universe, size_t term_id)
+            : m_n(n)
+            , m_base(blocks)
+            , m_blocks(succinct::util::ceil_div(m_n, BlockCodec::block_size))
+            , m_block_maxs(m_base)
+            , m_block_endpoints(m_block_maxs + 4 * m_blocks)
+            , m_blocks_data(m_block_endpoints + 4 * (m_blocks - 1))
+            , m_universe(universe) {
+            open(term_id);
         }
 
         void reset() {
@@ -144,6 +152,21 @@ struct block_posting_list {
             }
         }
 
+        // prefetches the block that next_geq(lower_bound) decodes if it
+        // leaves the current one, found on the block maxima as next_geq
+        // does. Nothing is moved.
+        void DS2I_ALWAYSINLINE prefetch_geq(uint64_t lower_bound) const {
+            if (DS2I_LIKELY(lower_bound <= m_cur_block_max)) return;
+            if (lower_bound > block_max(m_blocks - 1)) return;
+
+            uint64_t block = m_cur_block + 1;
+            while (block_max(block) < lower_bound) {
+                ++block;
+            }
+            uint32_t endpoint = ((uint32_t const*)m_block_endpoints)[block - 1];
+            succinct::intrinsics::prefetch(m_blocks_data + endpoint);
+        }
+
         void DS2I_ALWAYSINLINE move(uint64_t pos) {
             uint64_t block = pos / BlockCodec::block_size;
             if (DS2I_UNLIKELY(block != m_cur_block)) {
@@ -177,6 +200,11 @@ struct block_posting_list {
             return m_blocks;
         }
 
+        // the blocks are the units next_geq skips over
+        uint64_t num_partitions() const {
+            return m_blocks;
+        }
+
         uint64_t stats_freqs_size() const {
             // XXX rewrite in terms of get_blocks()
             uint64_t bytes = 0;
@@ -269,6 +297,17 @@ struct block_posting_list {
         }
 
     private:
+        void open(size_t term_id) {
+            if (Profile) {
+                // std::cout << "OPEN\t" << m_term_id << "\t" << m_blocks <<
+                // "\n";
+                m_block_profile = block_profiler::open_list(term_id, m_blocks);
+            }
+            m_docs_buf.resize(BlockCodec::block_size);
+            m_freqs_buf.resize(BlockCodec::block_size);
+            reset();
+        }
+
         uint32_t block_max(uint32_t block) const {
             return ((uint32_t const*)m_block_maxs)[block];
         }
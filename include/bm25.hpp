@@ -9,8 +9,20 @@ struct bm25 {
     static constexpr float k1 = 1.2;
 
     static float doc_term_weight(uint64_t freq, float norm_len) {
+        return doc_term_weight_denominator(freq,
+                                           length_denominator(norm_len));
+    }
+
+    // the part of the denominator of doc_term_weight that depends only on
+    // the document, so that it can be precomputed (see wand_data)
+    static float length_denominator(float norm_len) {
+        return k1 * (1.0f - b + b * norm_len);
+    }
+
+    static float doc_term_weight_denominator(uint64_t freq,
+                                             float denominator) {
         float f = (float)freq;
-        return f / (f + k1 * (1.0f - b + b * norm_len));
+        return f / (f + denominator);
     }
 
     // IDF (inverse document frequency)
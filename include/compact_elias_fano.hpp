@@ -1,13 +1,17 @@
 #pragma once
 
 #include <stdexcept>
+#include <immintrin.h>
 
 #include "succinct/bit_vector.hpp"
 #include "succinct/broadword.hpp"
 
+#include "cpu_features.hpp"
 #include "global_parameters.hpp"
 #include "typedefs.hpp"
+#include "unary_enumerator.hpp"
 #include "util.hpp"
+#include "bitmap_tables.h"
 
 namespace pvb {
 
@@ -174,8 +178,7 @@ struct compact_elias_fano {
                 if (DS2I_UNLIKELY(m_position == size())) {
                     m_value = m_of.universe;
                 } else {
-                    succinct::bit_vector::unary_enumerator he =
-                        m_high_enumerator;
+                    unary_enumerator he = m_high_enumerator;
                     for (size_t i = 0; i < skip; ++i) {
                         he.next();
                     }
@@ -268,7 +271,107 @@ struct compact_elias_fano {
             return pv_type(m_position, m_value);
         }
 
+        // Decode the first n values of the sequence in out, without
+        // changing the state of the enumerator.
+        void decode(uint64_t* out, uint64_t n) const {
+            assert(n <= size());
+            static const bool has_avx2 = cpu_features::get().avx2;
+            if (has_avx2) {
+                decode_avx2(out, n);
+            } else {
+                decode_scalar(out, n);
+            }
+        }
+
     private:
+        void decode_scalar(uint64_t* out, uint64_t n) const {
+            unary_enumerator he(*m_bv, m_of.higher_bits_offset);
+            uint64_t lower_base = m_of.lower_bits_offset;
+            for (uint64_t i = 0; i < n; ++i) {
+                uint64_t high = he.next() - m_of.higher_bits_offset - i - 1;
+                uint64_t low = m_bv->get_word56(lower_base) & m_of.mask;
+                out[i] = (high << m_of.lower_bits) | low;
+                lower_base += m_of.lower_bits;
+            }
+        }
+
+        // The upper bits are decoded one byte at a time through the table
+        // of the positions of its set bits: since the i-th one is at
+        // position high(i) + i + 1, subtracting the rank from the positions
+        // gives 8 upper parts at once. The lower bits are then gathered 4 at
+        // a time and merged in place.
+        __attribute__((target("avx2"))) void decode_avx2(uint64_t* out,
+                                                          uint64_t n) const {
+            uint64_t i = 0;
+            uint64_t pos = 0;  // relative to higher_bits_offset
+            __m256i const iota_lo = _mm256_setr_epi64x(0, 1, 2, 3);
+            __m256i const iota_hi = _mm256_setr_epi64x(4, 5, 6, 7);
+            while (i + 8 <= n) {
+                // 56 bits are always valid, so consume 7 bytes per word
+                uint64_t word =
+                    m_bv->get_word56(m_of.higher_bits_offset + pos);
+                for (uint64_t k = 0; k < 7 and i + 8 <= n; ++k, pos += 8) {
+                    uint8_t byte = word & 0xFF;
+                    word >>= 8;
+                    if (!byte) {
+                        continue;
+                    }
+                    // table positions are 1-based
+                    __m256i positions =
+                        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(
+                            vecDecodeTable[byte]));
+                    __m256i base = _mm256_set1_epi64x(pos - i - 2);
+                    __m256i lo = _mm256_cvtepu32_epi64(
+                        _mm256_castsi256_si128(positions));
+                    __m256i hi = _mm256_cvtepu32_epi64(
+                        _mm256_extracti128_si256(positions, 1));
+                    lo = _mm256_sub_epi64(_mm256_add_epi64(lo, base), iota_lo);
+                    hi = _mm256_sub_epi64(_mm256_add_epi64(hi, base), iota_hi);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                                        lo);
+                    _mm256_storeu_si256(
+                        reinterpret_cast<__m256i*>(out + i + 4), hi);
+                    i += lengthTable[byte];
+                }
+            }
+
+            if (i < n) {
+                unary_enumerator he(*m_bv, m_of.higher_bits_offset + pos);
+                for (; i < n; ++i) {
+                    out[i] = he.next() - m_of.higher_bits_offset - i - 1;
+                }
+            }
+
+            uint8_t const* bytes =
+                reinterpret_cast<uint8_t const*>(m_bv->data().data());
+            uint64_t l = m_of.lower_bits;
+            uint64_t offset = m_of.lower_bits_offset;
+            __m256i offsets = _mm256_setr_epi64x(
+                offset, offset + l, offset + 2 * l, offset + 3 * l);
+            __m256i const step = _mm256_set1_epi64x(4 * l);
+            __m256i const mask = _mm256_set1_epi64x(m_of.mask);
+            __m256i const seven = _mm256_set1_epi64x(7);
+            __m128i const shift = _mm_cvtsi64_si128(l);
+            for (i = 0; i + 4 <= n; i += 4) {
+                __m256i words = _mm256_i64gather_epi64(
+                    reinterpret_cast<long long const*>(bytes),
+                    _mm256_srli_epi64(offsets, 3), 1);
+                words = _mm256_srlv_epi64(words,
+                                          _mm256_and_si256(offsets, seven));
+                __m256i* ptr = reinterpret_cast<__m256i*>(out + i);
+                __m256i high = _mm256_sll_epi64(_mm256_loadu_si256(ptr), shift);
+                _mm256_storeu_si256(
+                    ptr, _mm256_or_si256(high, _mm256_and_si256(words, mask)));
+                offsets = _mm256_add_epi64(offsets, step);
+            }
+            for (; i < n; ++i) {
+                uint64_t low = m_bv->get_word56(m_of.lower_bits_offset +
+                                                i * m_of.lower_bits) &
+                               m_of.mask;
+                out[i] = (out[i] << m_of.lower_bits) | low;
+            }
+        }
+
         pv_type DS2I_NOINLINE slow_move(uint64_t position) {
             if (DS2I_UNLIKELY(position == size())) {
                 m_position = position;
@@ -284,7 +387,7 @@ struct compact_elias_fano {
                 uint64_t ptr = position >> m_of.log_sampling1;
                 uint64_t high_pos = pointer1(ptr);
                 uint64_t high_rank = ptr << m_of.log_sampling1;
-                m_high_enumerator = succinct::bit_vector::unary_enumerator(
+                m_high_enumerator = unary_enumerator(
                     *m_bv, m_of.higher_bits_offset + high_pos);
                 to_skip = position - high_rank;
             }
@@ -317,7 +420,7 @@ struct compact_elias_fano {
                 uint64_t high_pos = pointer0(ptr);
                 uint64_t high_rank0 = ptr << m_of.log_sampling0;
 
-                m_high_enumerator = succinct::bit_vector::unary_enumerator(
+                m_high_enumerator = unary_enumerator(
                     *m_bv, m_of.higher_bits_offset + high_pos);
                 to_skip = high_lower_bound - high_rank0;
             }
@@ -378,7 +481,7 @@ struct compact_elias_fano {
             }
 
             enumerator& e;
-            succinct::bit_vector::unary_enumerator high_enumerator;
+            unary_enumerator high_enumerator;
             uint64_t high_base, lower_bits, lower_base, mask;
             succinct::bit_vector const& bv;
         };
@@ -405,7 +508,7 @@ struct compact_elias_fano {
 
         uint64_t m_position;
         uint64_t m_value;
-        succinct::bit_vector::unary_enumerator m_high_enumerator;
+        unary_enumerator m_high_enumerator;
     };
 };
 }  // namespace pvb
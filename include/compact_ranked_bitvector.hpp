@@ -252,6 +252,32 @@ struct compact_ranked_bitvector {
             return pos - m_of.bits_offset;
         }
 
+        // the 64 bits of the bitmap from value from on: bit i is set if
+        // from + i is in the sequence (the bits past the universe belong to
+        // what follows the sequence)
+        uint64_t bits(uint64_t from) const {
+            return m_bv->get_word(m_of.bits_offset + from);
+        }
+
+        // ORs the bits of the values in [from, from + len) into out, the
+        // bit of from + i going to bit out_bit + i
+        void or_bits(uint64_t from, uint64_t len, uint64_t* out,
+                     uint64_t out_bit) const {
+            while (len) {
+                uint64_t l = std::min<uint64_t>(len, 64);
+                uint64_t word = bits(from);
+                if (l < 64) word &= (uint64_t(1) << l) - 1;
+                uint64_t shift = out_bit % 64;
+                out[out_bit / 64] |= word << shift;
+                if (shift and shift + l > 64) {
+                    out[out_bit / 64 + 1] |= word >> (64 - shift);
+                }
+                from += l;
+                out_bit += l;
+                len -= l;
+            }
+        }
+
     private:
         value_type DS2I_NOINLINE slow_move(uint64_t position) {
             uint64_t skip = position - m_position;
@@ -29,6 +29,7 @@ public:
         fillvar("DS2I_LOG_PART", log_partition_size, 7);
         fillvar("DS2I_THREADS", worker_threads,
                 std::thread::hardware_concurrency());
+        fillvar("DS2I_SHARDS", num_shards, worker_threads);
         executor.reset(new executor_type(worker_threads));
     }
 
@@ -40,6 +41,7 @@ public:
     uint64_t k;
     size_t log_partition_size;
     size_t worker_threads;
+    size_t num_shards;
 
     std::unique_ptr<executor_type> executor;
 
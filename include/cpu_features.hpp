@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+namespace pvb {
+
+// Instruction set extensions detected at runtime, so that a binary built for
+// a generic target can still take the fast paths on machines supporting them.
+//
+// The SIMD decoders are compiled for a few ISA levels (see block_codecs.hpp)
+// and the best one supported by the CPU is selected at startup. Setting
+// DS2I_ISA to sse4.1 or avx2 caps the selected level. Setting DS2I_NO_BMI2
+// (DS2I_NO_AVX2) in the environment disables the BMI2 (AVX2) code paths,
+// which is useful to compare them against the fallbacks.
+struct cpu_features {
+    enum isa_level { isa_sse41 = 0, isa_avx2 = 1, isa_avx512 = 2 };
+
+    static cpu_features const& get() {
+        static cpu_features instance;
+        return instance;
+    }
+
+    static const char* isa_name(isa_level level) {
+        static const char* names[] = {"sse4.1", "avx2", "avx512"};
+        return names[level];
+    }
+
+    const char* isa_name() const {
+        return isa_name(isa);
+    }
+
+    isa_level isa;
+    bool bmi2;
+    bool avx2;
+
+private:
+    cpu_features() {
+        __builtin_cpu_init();
+
+        isa = isa_sse41;
+        if (__builtin_cpu_supports("avx2") and
+            __builtin_cpu_supports("bmi2")) {
+            isa = isa_avx2;
+            if (__builtin_cpu_supports("avx512f") and
+                __builtin_cpu_supports("avx512bw") and
+                __builtin_cpu_supports("avx512dq") and
+                __builtin_cpu_supports("avx512vl")) {
+                isa = isa_avx512;
+            }
+        }
+
+        const char* cap = std::getenv("DS2I_ISA");
+        if (cap and strlen(cap)) {
+            for (int level = isa_sse41; level <= isa_avx512; ++level) {
+                if (!strcmp(cap, isa_name(isa_level(level)))) {
+                    if (level < isa) isa = isa_level(level);
+                    break;
+                }
+            }
+        }
+
+        // pdep/pext are microcoded on AMD before Zen 3, much slower than the
+        // broadword select they would replace
+        bool slow_pdep = __builtin_cpu_is("amdfam15h") or
+                         __builtin_cpu_is("amdfam17h");
+        bmi2 = isa >= isa_avx2 and !slow_pdep and !env_flag("DS2I_NO_BMI2");
+        avx2 = isa >= isa_avx2 and !env_flag("DS2I_NO_AVX2");
+    }
+
+    static bool env_flag(const char* envvar) {
+        const char* val = std::getenv(envvar);
+        return val and strlen(val) and strcmp(val, "0");
+    }
+};
+
+}  // namespace pvb
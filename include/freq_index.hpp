@@ -2,13 +2,20 @@
 
 #include "bitvector_collection.hpp"
 #include "compact_elias_fano.hpp"
+#include "compact_ranked_bitvector.hpp"
 #include "integer_codes.hpp"
 #include "global_parameters.hpp"
 #include "configuration.hpp"
+#include "term_directory.hpp"
 
 namespace pvb {
 
-template <typename DocsSequence, typename FreqsSequence>
+// With Interleaved, the docs and freqs sequences of each list are adjacent in
+// m_docs_sequences (m_freqs_sequences stays empty), so that opening a list
+// takes a single endpoint lookup and scoring touches a single memory region.
+// Each list then starts with the size of its docs part.
+template <typename DocsSequence, typename FreqsSequence,
+          bool Interleaved = false>
 struct freq_index {
     freq_index() : m_params(), m_num_docs(0) {}
 
@@ -26,6 +33,12 @@ struct freq_index {
             if (!n)
                 throw std::invalid_argument("List must be nonempty");
 
+            if (Interleaved) {
+                add_interleaved_posting_list(n, docs_begin, freqs_begin,
+                                             occurrences, conf);
+                return;
+            }
+
             task_region(*conf.executor, [&](task_region_handle& trh) {
                 trh.run([&] {
                     succinct::bit_vector_builder docs_bits;
@@ -49,11 +62,56 @@ struct freq_index {
             });
         }
 
+        template <typename DocsIterator, typename FreqsIterator>
+        void add_interleaved_posting_list(uint64_t n, DocsIterator docs_begin,
+                                          FreqsIterator freqs_begin,
+                                          uint64_t occurrences,
+                                          configuration const& conf) {
+            succinct::bit_vector_builder docs_bits;
+            succinct::bit_vector_builder freqs_bits;
+            task_region(*conf.executor, [&](task_region_handle& trh) {
+                trh.run([&] {
+                    DocsSequence::write(docs_bits, docs_begin, m_num_docs, n,
+                                        m_params, conf);
+                    push_pad(docs_bits, alignment);
+                });
+
+                FreqsSequence::write(freqs_bits, freqs_begin,
+                                     occurrences + 1, n, m_params, conf);
+                push_pad(freqs_bits, alignment);
+            });
+
+            succinct::bit_vector_builder list_bits;
+            write_gamma_nonzero(list_bits, occurrences);
+            if (occurrences > 1) {
+                list_bits.append_bits(n, ceil_log2(occurrences + 1));
+            }
+            write_delta(list_bits, docs_bits.size() / alignment);
+            push_pad(list_bits, alignment);
+            list_bits.append(docs_bits);
+            list_bits.append(freqs_bits);
+            m_docs_sequences.append(list_bits);
+        }
+
+        // appends a list whose docs and freqs have already been encoded, with
+        // the same layout written by add_posting_list (see index_merge.hpp)
+        void add_encoded_posting_list(
+            succinct::bit_vector_builder& docs_bits,
+            succinct::bit_vector_builder& freqs_bits) {
+            assert(!Interleaved);
+            assert(docs_bits.size() % alignment == 0);
+            assert(freqs_bits.size() % alignment == 0);
+            m_docs_sequences.append(docs_bits);
+            m_freqs_sequences.append(freqs_bits);
+        }
+
         void build(freq_index& sq) {
             sq.m_num_docs = m_num_docs;
             sq.m_params = m_params;
             m_docs_sequences.build(sq.m_docs_sequences);
-            m_freqs_sequences.build(sq.m_freqs_sequences);
+            if (!Interleaved) {
+                m_freqs_sequences.build(sq.m_freqs_sequences);
+            }
         }
 
     private:
@@ -89,6 +147,39 @@ struct freq_index {
             m_cur_docid = val.second;
         }
 
+        void prefetch_geq(uint64_t lower_bound) const {
+            m_docs_enum.prefetch_geq(lower_bound);
+        }
+
+        // sets bit d - begin of words for each docid d from the current one
+        // up to end (excluded), and moves to the first docid not before end;
+        // the bitmap partitions are ORed word by word
+        void fill_bitmap(uint64_t* words, uint64_t begin, uint64_t end) {
+            while (m_cur_docid < end) {
+                auto const* bitmap = m_docs_enum.partition_bitmap();
+                if (bitmap) {
+                    uint64_t last =
+                        std::min(end - 1, m_docs_enum.partition_upper_bound());
+                    bitmap->or_bits(m_cur_docid - m_docs_enum.partition_base(),
+                                    last + 1 - m_cur_docid, words,
+                                    m_cur_docid - begin);
+                    next_geq(last + 1);
+                } else {
+                    uint64_t bit = m_cur_docid - begin;
+                    words[bit / 64] |= uint64_t(1) << (bit % 64);
+                    next();
+                }
+            }
+        }
+
+        // the scan mode of the docids enumerator, if any (see open_scan in
+        // util.hpp)
+        template <typename DocsEnum = typename DocsSequence::enumerator>
+        auto open_scan(std::vector<uint64_t>& metadata)
+            -> decltype(std::declval<DocsEnum&>().open_scan(metadata)) {
+            m_docs_enum.open_scan(metadata);
+        }
+
         void DS2I_FLATTEN_FUNC move(uint64_t position) {
             auto val = m_docs_enum.move(position);
             m_cur_pos = val.first;
@@ -111,6 +202,24 @@ struct freq_index {
             return m_docs_enum.size();
         }
 
+        uint64_t num_partitions() const {
+            return m_docs_enum.num_partitions();
+        }
+
+        // the current partition of the docids: its range, and its bits if it
+        // is stored as a bitmap (see partitioned_sequence_enumerator)
+        uint64_t partition_base() const {
+            return m_docs_enum.partition_base();
+        }
+
+        uint64_t partition_upper_bound() const {
+            return m_docs_enum.partition_upper_bound();
+        }
+
+        compact_ranked_bitvector::enumerator const* partition_bitmap() const {
+            return m_docs_enum.partition_bitmap();
+        }
+
         typename DocsSequence::enumerator const& docs_enum() const {
             return m_docs_enum;
         }
@@ -139,29 +248,66 @@ struct freq_index {
         typename FreqsSequence::enumerator m_freqs_enum;
     };
 
+    struct list_header {
+        uint64_t occurrences;
+        uint64_t n;
+        uint64_t docs_offset;
+        uint64_t freqs_offset;
+    };
+
     document_enumerator operator[](size_t i) {
         assert(i < size());
-        auto docs_it = m_docs_sequences.get(m_params, i);
-        uint64_t occurrences = read_gamma_nonzero(docs_it);
-        uint64_t n = 1;
-        if (occurrences > 1) {
-            n = docs_it.take(ceil_log2(occurrences + 1));
+        return open_list(header(i));
+    }
+
+    list_header header(size_t i) const {
+        assert(i < size());
+        if (!m_directory.empty()) {
+            return m_directory[i];
         }
+        return read_header(i);
+    }
 
-        typename DocsSequence::enumerator docs_enum(m_docs_sequences.bits(),
-                                                    docs_it.position(),
-                                                    num_docs(), n, m_params);
+    // the encoded lists, for the tools that work on the bits directly
+    bitvector_collection const& docs_sequences() const {
+        return m_docs_sequences;
+    }
 
-        auto freqs_it = m_freqs_sequences.get(m_params, i);
-        typename FreqsSequence::enumerator freqs_enum(
-            m_freqs_sequences.bits(), freqs_it.position(), occurrences + 1, n,
-            m_params);
+    bitvector_collection const& freqs_sequences() const {
+        return m_freqs_sequences;
+    }
 
-        return document_enumerator(docs_enum, freqs_enum);
+    // fills the term directory, after which opening a list reads only its
+    // entry
+    void build_term_directory() {
+        std::vector<list_header> entries;
+        entries.reserve(size());
+        for (size_t i = 0; i < size(); ++i) {
+            entries.push_back(read_header(i));
+        }
+        m_directory.build(entries);
+    }
+
+    uint64_t term_directory_size() const {
+        return m_directory.size() * sizeof(list_header);
+    }
+
+    // size in bits of the freqs sequence of list i (including padding), for
+    // the statistics of the interleaved layout
+    uint64_t freqs_bits(size_t i) const {
+        assert(Interleaved);
+        return m_docs_sequences.range(m_params, i).second -
+               read_header(i).freqs_offset;
     }
 
-    void warmup(size_t /* i */) const {
-        // XXX implement this
+    void warmup(size_t i) const {
+        assert(i < size());
+        auto docs = m_docs_sequences.range(m_params, i);
+        warmup_bits(m_docs_sequences.bits(), docs.first, docs.second);
+        if (!Interleaved) {
+            auto freqs = m_freqs_sequences.range(m_params, i);
+            warmup_bits(m_freqs_sequences.bits(), freqs.first, freqs.second);
+        }
     }
 
     global_parameters& params() {
@@ -173,19 +319,60 @@ struct freq_index {
         std::swap(m_num_docs, other.m_num_docs);
         m_docs_sequences.swap(other.m_docs_sequences);
         m_freqs_sequences.swap(other.m_freqs_sequences);
+        m_directory.swap(other.m_directory);
     }
 
     template <typename Visitor>
     void map(Visitor& visit) {
         visit(m_params, "m_params")(m_num_docs, "m_num_docs")(
-            m_docs_sequences, "m_docs_sequences")(m_freqs_sequences,
-                                                  "m_freqs_sequences");
+            m_docs_sequences, "m_docs_sequences")(
+            m_freqs_sequences, "m_freqs_sequences");
+    }
+
+    // not mapped with the rest of the index (see term_directory)
+    term_directory<list_header>& directory() {
+        return m_directory;
     }
 
 private:
+    list_header read_header(size_t i) const {
+        list_header header;
+        auto it = m_docs_sequences.get(m_params, i);
+        header.occurrences = read_gamma_nonzero(it);
+        header.n = 1;
+        if (header.occurrences > 1) {
+            header.n = it.take(ceil_log2(header.occurrences + 1));
+        }
+
+        if (Interleaved) {
+            uint64_t docs_size = read_delta(it) * alignment;
+            eat_pad(it, alignment);
+            header.docs_offset = it.position();
+            header.freqs_offset = header.docs_offset + docs_size;
+        } else {
+            header.docs_offset = it.position();
+            header.freqs_offset =
+                m_freqs_sequences.get(m_params, i).position();
+        }
+        return header;
+    }
+
+    document_enumerator open_list(list_header const& header) {
+        auto const& freqs_bits = Interleaved ? m_docs_sequences.bits()
+                                             : m_freqs_sequences.bits();
+        typename DocsSequence::enumerator docs_enum(
+            m_docs_sequences.bits(), header.docs_offset, num_docs(), header.n,
+            m_params);
+        typename FreqsSequence::enumerator freqs_enum(
+            freqs_bits, header.freqs_offset, header.occurrences + 1, header.n,
+            m_params);
+        return document_enumerator(docs_enum, freqs_enum);
+    }
+
     global_parameters m_params;
     uint64_t m_num_docs;
     bitvector_collection m_docs_sequences;
     bitvector_collection m_freqs_sequences;
+    term_directory<list_header> m_directory;
 };
 }  // namespace pvb
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "binary_freq_collection.hpp"
+#include "util.hpp"
+
+namespace pvb {
+
+// Docid reordering by recursive graph bisection (Dhulipala et al., KDD 2016).
+//
+// The documents are seen as the left side of a bipartite graph whose right
+// side are the terms. The document range is split in two halves, and
+// documents are swapped between the halves as long as this decreases the
+// estimated cost of encoding the gaps of each term,
+//
+//     cost(deg, n) = deg * log2(n / (deg + 1))
+//
+// summed over the two halves, where deg is the number of documents of the
+// half containing the term and n the size of the half. Then the two halves
+// are reordered recursively, until they contain at most min_partition
+// documents or max_depth is reached. The first levels run in parallel, and
+// the gains of the largest partitions are computed by several threads.
+class graph_bisection {
+public:
+    struct parameters {
+        parameters()
+            : min_list_length(0)
+            , max_depth(0)
+            , min_partition(16)
+            , iterations(20)
+            , threads(std::thread::hardware_concurrency()) {}
+
+        uint64_t min_list_length;  // shorter lists are ignored
+        uint64_t max_depth;        // 0 means log2(num_docs) - 5
+        uint64_t min_partition;
+        uint64_t iterations;
+        uint64_t threads;
+    };
+
+    graph_bisection(binary_freq_collection const& input,
+                    parameters const& params)
+        : m_params(params), m_num_docs(input.num_docs()) {
+        build_forward_index(input);
+        m_log2.resize(m_num_docs + 2);
+        m_log2[0] = 0;
+        for (uint64_t i = 1; i < m_log2.size(); ++i) {
+            m_log2[i] = std::log2(float(i));
+        }
+        if (!m_params.max_depth) {
+            m_params.max_depth =
+                std::max<int64_t>(1, int64_t(ceil_log2(m_num_docs)) - 5);
+        }
+        m_params.threads = std::max<uint64_t>(1, m_params.threads);
+    }
+
+    // returns the new docid of each document
+    std::vector<uint32_t> compute_permutation() {
+        std::vector<uint32_t> docs(m_num_docs);
+        std::iota(docs.begin(), docs.end(), 0);
+        workspace ws(m_num_terms);
+        bisect(ws, docs.data(), docs.data() + docs.size(), 0,
+               m_params.threads);
+
+        std::vector<uint32_t> new_ids(m_num_docs);
+        for (uint32_t i = 0; i < m_num_docs; ++i) {
+            new_ids[docs[i]] = i;
+        }
+        return new_ids;
+    }
+
+    uint64_t num_terms() const {
+        return m_num_terms;
+    }
+
+    uint64_t num_edges() const {
+        return m_terms.size();
+    }
+
+private:
+    // degrees of the terms in the two halves being refined, one per thread
+    // of the recursion; entries are reset to zero after each use
+    struct workspace {
+        workspace(uint64_t num_terms)
+            : left_degrees(num_terms, 0), right_degrees(num_terms, 0) {}
+
+        std::vector<uint32_t> left_degrees;
+        std::vector<uint32_t> right_degrees;
+    };
+
+    void build_forward_index(binary_freq_collection const& input) {
+        std::vector<uint64_t> doc_degrees(m_num_docs + 1, 0);
+        m_num_terms = 0;
+        for (auto const& plist : input) {
+            if (plist.docs.size() < m_params.min_list_length) continue;
+            for (auto doc : plist.docs) {
+                doc_degrees[doc + 1] += 1;
+            }
+            ++m_num_terms;
+        }
+        std::partial_sum(doc_degrees.begin(), doc_degrees.end(),
+                         doc_degrees.begin());
+        m_offsets = doc_degrees;
+        m_terms.resize(m_offsets.back());
+
+        uint32_t term = 0;
+        for (auto const& plist : input) {
+            if (plist.docs.size() < m_params.min_list_length) continue;
+            for (auto doc : plist.docs) {
+                m_terms[doc_degrees[doc]++] = term;
+            }
+            ++term;
+        }
+    }
+
+    uint32_t const* terms_begin(uint32_t doc) const {
+        return m_terms.data() + m_offsets[doc];
+    }
+
+    uint32_t const* terms_end(uint32_t doc) const {
+        return m_terms.data() + m_offsets[doc + 1];
+    }
+
+    float cost(uint32_t deg, uint64_t n) const {
+        return deg * (m_log2[n] - m_log2[deg + 1]);
+    }
+
+    // decrease of the cost when moving doc from the half with degrees from
+    // (and size n_from) to the other one
+    float move_gain(uint32_t doc, std::vector<uint32_t> const& from,
+                    std::vector<uint32_t> const& to, uint64_t n_from,
+                    uint64_t n_to) const {
+        float gain = 0;
+        for (auto t = terms_begin(doc); t != terms_end(doc); ++t) {
+            uint32_t f = from[*t];
+            uint32_t g = to[*t];
+            gain += cost(f, n_from) + cost(g, n_to) - cost(f - 1, n_from) -
+                    cost(g + 1, n_to);
+        }
+        return gain;
+    }
+
+    template <typename Function>
+    static void parallel_for(uint64_t n, uint64_t threads, Function f) {
+        threads = std::min(threads, n / 4096 + 1);
+        uint64_t chunk = succinct::util::ceil_div(n, threads);
+        std::vector<std::thread> workers;
+        for (uint64_t begin = chunk; begin < n; begin += chunk) {
+            uint64_t end = std::min(begin + chunk, n);
+            workers.emplace_back([=] { f(begin, end); });
+        }
+        f(0, std::min(chunk, n));
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    void update_degrees(std::vector<uint32_t>& degrees, uint32_t const* begin,
+                        uint32_t const* end, int delta) const {
+        for (auto doc = begin; doc != end; ++doc) {
+            for (auto t = terms_begin(*doc); t != terms_end(*doc); ++t) {
+                degrees[*t] += delta;
+            }
+        }
+    }
+
+    void bisect(workspace& ws, uint32_t* begin, uint32_t* end, uint64_t depth,
+                uint64_t threads) {
+        uint64_t n = end - begin;
+        if (n <= m_params.min_partition or depth >= m_params.max_depth) {
+            return;
+        }
+        uint32_t* mid = begin + n / 2;
+        uint64_t n_left = mid - begin;
+        uint64_t n_right = end - mid;
+
+        auto& left = ws.left_degrees;
+        auto& right = ws.right_degrees;
+        update_degrees(left, begin, mid, 1);
+        update_degrees(right, mid, end, 1);
+
+        std::vector<std::pair<float, uint32_t>> gains(n);
+        for (uint64_t iter = 0; iter < m_params.iterations; ++iter) {
+            parallel_for(n, threads, [&](uint64_t b, uint64_t e) {
+                for (uint64_t i = b; i < e; ++i) {
+                    uint32_t doc = begin[i];
+                    gains[i].first =
+                        i < n_left
+                            ? move_gain(doc, left, right, n_left, n_right)
+                            : move_gain(doc, right, left, n_right, n_left);
+                    gains[i].second = doc;
+                }
+            });
+
+            auto by_gain = [](auto const& a, auto const& b) {
+                return a.first > b.first;
+            };
+            std::sort(gains.begin(), gains.begin() + n_left, by_gain);
+            std::sort(gains.begin() + n_left, gains.end(), by_gain);
+
+            uint64_t swaps = 0;
+            for (uint64_t i = 0; i < n_right and i < n_left; ++i, ++swaps) {
+                auto& l = gains[i];
+                auto& r = gains[n_left + i];
+                if (l.first + r.first <= 0) break;
+                for (auto t = terms_begin(l.second); t != terms_end(l.second);
+                     ++t) {
+                    left[*t] -= 1;
+                    right[*t] += 1;
+                }
+                for (auto t = terms_begin(r.second); t != terms_end(r.second);
+                     ++t) {
+                    right[*t] -= 1;
+                    left[*t] += 1;
+                }
+                std::swap(l.second, r.second);
+            }
+            for (uint64_t i = 0; i < n; ++i) {
+                begin[i] = gains[i].second;
+            }
+            if (!swaps) break;
+        }
+
+        update_degrees(left, begin, mid, -1);
+        update_degrees(right, mid, end, -1);
+        std::vector<std::pair<float, uint32_t>>().swap(gains);
+
+        if (threads > 1) {
+            uint64_t left_threads = threads / 2;
+            std::thread left_worker([&] {
+                workspace left_ws(m_num_terms);
+                bisect(left_ws, begin, mid, depth + 1, left_threads);
+            });
+            bisect(ws, mid, end, depth + 1, threads - left_threads);
+            left_worker.join();
+        } else {
+            bisect(ws, begin, mid, depth + 1, 1);
+            bisect(ws, mid, end, depth + 1, 1);
+        }
+    }
+
+    parameters m_params;
+    uint64_t m_num_docs;
+    uint64_t m_num_terms;
+    std::vector<uint64_t> m_offsets;
+    std::vector<uint32_t> m_terms;
+    std::vector<float> m_log2;
+};
+
+}  // namespace pvb
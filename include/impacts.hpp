@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "binary_freq_collection.hpp"
+#include "bm25.hpp"
+#include "util.hpp"
+
+namespace pvb {
+
+// Quantized impacts, stored in an index in place of the frequencies (see
+// create_freq_index --impacts). The impact of a posting is its Scorer score
+// for a query containing the term once, that is the term weight times the
+// document weight, mapped linearly to [1, max_impact] over the maximum score
+// of the collection. Ranked queries then only add integers (see
+// impact_ranked_and_query), without the document lengths.
+template <typename Scorer = bm25>
+class impact_quantizer {
+public:
+    static const uint32_t max_impact = 255;
+
+    template <typename LengthsIterator>
+    impact_quantizer(LengthsIterator len_it,
+                     binary_freq_collection const& coll)
+        : m_num_docs(coll.num_docs()), m_max_score(0) {
+        std::vector<float> norm_lens(m_num_docs);
+        double lens_sum = 0;
+        for (size_t i = 0; i < m_num_docs; ++i) {
+            norm_lens[i] = *len_it++;
+            lens_sum += norm_lens[i];
+        }
+        float avg_len = float(lens_sum / double(m_num_docs));
+        for (auto& len : norm_lens) {
+            len /= avg_len;
+        }
+        m_norm_lens.swap(norm_lens);
+
+        for (auto const& seq : coll) {
+            float term_weight = Scorer::query_term_weight(1, seq.docs.size(),
+                                                          m_num_docs);
+            for (size_t i = 0; i < seq.docs.size(); ++i) {
+                uint64_t docid = *(seq.docs.begin() + i);
+                uint64_t freq = *(seq.freqs.begin() + i);
+                float score = term_weight * Scorer::doc_term_weight(
+                                                freq, m_norm_lens[docid]);
+                m_max_score = std::max(m_max_score, score);
+            }
+        }
+    }
+
+    // fills impacts with the impacts of the n postings of a list
+    template <typename DocsIterator, typename FreqsIterator>
+    void quantize(uint64_t n, DocsIterator docs, FreqsIterator freqs,
+                  std::vector<uint32_t>& impacts) const {
+        float term_weight = Scorer::query_term_weight(1, n, m_num_docs);
+        float scale = max_impact / m_max_score;
+        impacts.resize(n);
+        for (size_t i = 0; i < n; ++i, ++docs, ++freqs) {
+            float score = term_weight * Scorer::doc_term_weight(
+                                            *freqs, m_norm_lens[*docs]);
+            impacts[i] = std::min<uint32_t>(
+                max_impact, std::max<uint32_t>(1, std::ceil(score * scale)));
+        }
+    }
+
+    // score of an impact of 1
+    float score_unit() const {
+        return m_max_score / max_impact;
+    }
+
+private:
+    uint64_t m_num_docs;
+    float m_max_score;
+    std::vector<float> m_norm_lens;
+};
+
+template <typename Scorer>
+const uint32_t impact_quantizer<Scorer>::max_impact;
+
+}  // namespace pvb
@@ -25,8 +25,8 @@ struct progress_logger {
     size_t sequences, postings;
 };
 
-template <typename DocsSequence, typename FreqsSequence>
-void get_size_stats(freq_index<DocsSequence, FreqsSequence>& coll,
+template <typename DocsSequence, typename FreqsSequence, bool Interleaved>
+void get_size_stats(freq_index<DocsSequence, FreqsSequence, Interleaved>& coll,
                     uint64_t& docs_size, uint64_t& freqs_size) {
     auto size_tree = succinct::mapper::size_tree_of(coll);
     size_tree->dump();
@@ -37,6 +37,16 @@ void get_size_stats(freq_index<DocsSequence, FreqsSequence>& coll,
             freqs_size = node->size;
         }
     }
+
+    if (Interleaved) {  // the freqs are stored with the docs
+        uint64_t freqs_bits = 0;
+        for (size_t i = 0; i < coll.size(); ++i) {
+            freqs_bits += coll.freqs_bits(i);
+        }
+        docs_size += freqs_size;
+        freqs_size = freqs_bits / 8;
+        docs_size -= freqs_size;
+    }
 }
 
 template <typename BlockCodec, bool Profile>
@@ -58,6 +68,21 @@ void get_size_stats(block_freq_index<BlockCodec, Profile>& coll,
     docs_size = total_size - freqs_size;
 }
 
+// sum of the shards; the term maps and the directory of the shards are
+// counted in neither
+template <typename Index>
+void get_size_stats(sharded_index<Index>& coll, uint64_t& docs_size,
+                    uint64_t& freqs_size) {
+    docs_size = freqs_size = 0;
+    for (size_t s = 0; s < coll.num_shards(); ++s) {
+        if (!coll.shard(s).size()) continue;
+        uint64_t shard_docs_size = 0, shard_freqs_size = 0;
+        get_size_stats(coll.shard(s), shard_docs_size, shard_freqs_size);
+        docs_size += shard_docs_size;
+        freqs_size += shard_freqs_size;
+    }
+}
+
 template <typename Collection>
 void dump_stats(Collection& coll, std::string const& type, uint64_t postings) {
     uint64_t docs_size = 0, freqs_size = 0;
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "util.hpp"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace pvb {
+
+// Read-only view of a serialized index, to be passed to
+// succinct::mapper::map.
+//
+// By default the file is memory mapped as before. With hugepages the file is
+// instead copied into anonymous memory backed by huge pages, so that the
+// random jumps of next_geq over large indexes do not thrash the TLB. The
+// pages are taken, in order of preference, from the hugetlbfs pools (1 GB
+// pages for indexes of at least 1 GB, then 2 MB pages, see
+// /proc/sys/vm/nr_hugepages) and otherwise from transparent huge pages via
+// madvise(MADV_HUGEPAGE); if the latter are disabled the copy ends up in
+// regular pages. mode() tells which path was taken.
+//
+// A freshly mapped file is faulted in lazily by the queries; warmup() instead
+// pre-faults it from several threads, each on its own slice of the file.
+class index_file {
+public:
+    static const uint64_t huge_page_2m = uint64_t(1) << 21;
+    static const uint64_t huge_page_1g = uint64_t(1) << 30;
+
+    index_file(const char* filename, bool hugepages, size_t threads = 1)
+        : m_data(nullptr)
+        , m_size(0)
+        , m_buffer(nullptr)
+        , m_buffer_size(0)
+        , m_mode("mmap") {
+        auto tick = get_time_usecs();
+        if (!hugepages) {
+            m_file.open(filename);
+            m_data = m_file.data();
+            m_size = m_file.size();
+        } else {
+            load(filename, threads);
+        }
+        m_load_time = (get_time_usecs() - tick) / 1000000;
+    }
+
+    ~index_file() {
+        if (m_buffer) {
+            munmap(m_buffer, m_buffer_size);
+        }
+    }
+
+    index_file(index_file const&) = delete;
+    index_file& operator=(index_file const&) = delete;
+
+    const char* data() const {
+        return m_data;
+    }
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    // one of mmap, hugetlb_1g, hugetlb_2m, thp
+    const char* mode() const {
+        return m_mode;
+    }
+
+    // seconds spent opening (or copying) the file
+    double load_time() const {
+        return m_load_time;
+    }
+
+    // brings the whole file in memory, splitting it across threads; returns
+    // the elapsed seconds
+    double warmup(size_t threads) const {
+        if (m_buffer) {
+            return 0;  // already resident
+        }
+        auto tick = get_time_usecs();
+        parallel_slices(threads, [&](uint64_t begin, uint64_t end) {
+            warmup_range(m_data + begin, end - begin);
+        });
+        return (get_time_usecs() - tick) / 1000000;
+    }
+
+private:
+    void load(const char* filename, size_t threads) {
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("Cannot open ") + filename);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            ::close(fd);
+            throw std::runtime_error(std::string("Cannot stat ") + filename);
+        }
+        m_size = st.st_size;
+
+        if (m_size >= huge_page_1g) {
+            allocate_hugetlb(huge_page_1g, 30, "hugetlb_1g");
+        }
+        if (!m_buffer) {
+            allocate_hugetlb(huge_page_2m, 21, "hugetlb_2m");
+        }
+        if (!m_buffer) {
+            allocate_thp();
+        }
+
+        char* dest = static_cast<char*>(m_buffer);
+        std::atomic<bool> failed(false);
+        parallel_slices(threads, [&](uint64_t begin, uint64_t end) {
+            while (begin < end) {
+                ssize_t ret = ::pread(fd, dest + begin, end - begin, begin);
+                if (ret <= 0) {
+                    failed = true;
+                    return;
+                }
+                begin += ret;
+            }
+        });
+        ::close(fd);
+        if (failed) {
+            throw std::runtime_error(std::string("Cannot read ") + filename);
+        }
+        m_data = dest;
+    }
+
+    // calls f(begin, end) on consecutive slices of the file, aligned to huge
+    // pages, from up to the given number of threads
+    template <typename Function>
+    void parallel_slices(size_t threads, Function f) const {
+        uint64_t slice = round_up(
+            succinct::util::ceil_div(m_size, std::max<size_t>(threads, 1)),
+            huge_page_2m);
+        std::vector<std::thread> workers;
+        for (uint64_t begin = slice; begin < m_size; begin += slice) {
+            uint64_t end = std::min(begin + slice, m_size);
+            workers.emplace_back([=] { f(begin, end); });
+        }
+        f(0, std::min(slice, m_size));
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+
+    void allocate_hugetlb(uint64_t page_size, int page_shift,
+                          const char* mode) {
+        uint64_t size = round_up(std::max<uint64_t>(m_size, 1), page_size);
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                           (page_shift << MAP_HUGE_SHIFT),
+                       -1, 0);
+        if (p != MAP_FAILED) {
+            m_buffer = p;
+            m_buffer_size = size;
+            m_mode = mode;
+        }
+    }
+
+    void allocate_thp() {
+        // over-allocate to align the start to a huge page boundary, as THP
+        // only backs aligned 2 MB ranges
+        uint64_t size = round_up(std::max<uint64_t>(m_size, 1), huge_page_2m);
+        uint64_t mapped_size = size + huge_page_2m;
+        void* p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+        uintptr_t aligned = round_up(begin, huge_page_2m);
+        if (aligned > begin) {
+            munmap(p, aligned - begin);
+        }
+        uint64_t tail = mapped_size - (aligned - begin) - size;
+        if (tail) {
+            munmap(reinterpret_cast<void*>(aligned + size), tail);
+        }
+        m_buffer = reinterpret_cast<void*>(aligned);
+        m_buffer_size = size;
+        madvise(m_buffer, m_buffer_size, MADV_HUGEPAGE);
+        m_mode = "thp";
+    }
+
+    static uint64_t round_up(uint64_t x, uint64_t page_size) {
+        return (x + page_size - 1) & ~(page_size - 1);
+    }
+
+    boost::iostreams::mapped_file_source m_file;
+    const char* m_data;
+    uint64_t m_size;
+    void* m_buffer;
+    uint64_t m_buffer_size;
+    const char* m_mode;
+    double m_load_time;
+};
+
+}  // namespace pvb
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "configuration.hpp"
+#include "freq_index.hpp"
+#include "partitioned_vb_sequence.hpp"
+#include "positive_sequence.hpp"
+#include "util.hpp"
+
+namespace pvb {
+
+// Merges two opt_vb indexes over the same term ids, the documents of the
+// second one following those of the first. The encoded lists are not decoded:
+// each merged list is the concatenation of the partitions of the two lists,
+// copied bit by bit, with new metadata (sizes, upper bounds and endpoints).
+// Only the first partition of the second list changes, since it is coded
+// relative to the last docid of the first list: in a VByte partition this is
+// just the code of the first gap, while a bitmap is encoded again, as a
+// bitmap or as VByte, whichever is smaller from the new base. The
+// frequencies are stored as prefix sums, so they are merged the same way,
+// shifted by the occurrences of the first list.
+//
+// The partitions are not optimal for the merged lists, as they never span
+// the two inputs, but they are those computed for each input. Short lists,
+// made of a single partition in both inputs, are encoded again as a whole.
+template <typename VBBlock>
+class opt_vb_merger {
+public:
+    typedef partitioned_vb_sequence<VBBlock> sequence_type;
+    typedef freq_index<sequence_type, positive_sequence<sequence_type>>
+        index_type;
+
+    struct statistics {
+        statistics()
+            : lists(0)
+            , merged_lists(0)
+            , postings(0)
+            , copied_bits(0)
+            , output_bits(0) {}
+
+        uint64_t lists;
+        uint64_t merged_lists;  // lists present in both indexes
+        uint64_t postings;
+        uint64_t copied_bits;  // partition bits copied as they are
+        uint64_t output_bits;
+    };
+
+    opt_vb_merger(index_type& a, index_type& b, configuration const& conf)
+        : m_a(a)
+        , m_b(b)
+        , m_conf(conf)
+        , m_num_docs(a.num_docs() + b.num_docs())
+        , m_params(a.params()) {}
+
+    void merge(index_type& out) {
+        typename index_type::builder builder(m_num_docs, m_params);
+        uint64_t lists = std::max(m_a.size(), m_b.size());
+        for (uint64_t i = 0; i < lists; ++i) {
+            succinct::bit_vector_builder docs_bits, freqs_bits;
+            if (i < m_a.size() and i < m_b.size()) {
+                merge_list(i, docs_bits, freqs_bits);
+            } else if (i < m_a.size()) {
+                copy_list(m_a, i, 0, docs_bits, freqs_bits);
+            } else {
+                copy_list(m_b, i, m_a.num_docs(), docs_bits, freqs_bits);
+            }
+            m_stats.output_bits += docs_bits.size() + freqs_bits.size();
+            builder.add_encoded_posting_list(docs_bits, freqs_bits);
+            m_stats.lists += 1;
+        }
+        builder.build(out);
+    }
+
+    statistics const& stats() const {
+        return m_stats;
+    }
+
+private:
+    typedef typename sequence_type::layout layout;
+
+    struct list_layout {
+        uint64_t occurrences;
+        uint64_t n;
+        layout docs;
+        layout freqs;
+    };
+
+    list_layout read_list(index_type& index, uint64_t i) const {
+        auto header = index.header(i);
+        auto docs_range = index.docs_sequences().range(m_params, i);
+        auto freqs_range = index.freqs_sequences().range(m_params, i);
+        list_layout l;
+        l.occurrences = header.occurrences;
+        l.n = header.n;
+        l.docs = sequence_type::read_layout(
+            index.docs_sequences().bits(), header.docs_offset,
+            docs_range.second, index.num_docs(), header.n, m_params);
+        l.freqs = sequence_type::read_layout(
+            index.freqs_sequences().bits(), header.freqs_offset,
+            freqs_range.second, header.occurrences + 1, header.n, m_params);
+        return l;
+    }
+
+    void write_header(succinct::bit_vector_builder& docs_bits,
+                      uint64_t occurrences, uint64_t n) const {
+        write_gamma_nonzero(docs_bits, occurrences);
+        if (occurrences > 1) {
+            docs_bits.append_bits(n, ceil_log2(occurrences + 1));
+        }
+    }
+
+    void merge_list(uint64_t i, succinct::bit_vector_builder& docs_bits,
+                    succinct::bit_vector_builder& freqs_bits) {
+        list_layout a = read_list(m_a, i);
+        list_layout b = read_list(m_b, i);
+        uint64_t occurrences = a.occurrences + b.occurrences;
+        write_header(docs_bits, occurrences, a.n + b.n);
+        concatenate(docs_bits, m_a.docs_sequences().bits(), a.docs,
+                    m_b.docs_sequences().bits(), b.docs, m_a.num_docs(),
+                    m_num_docs);
+        push_pad(docs_bits, alignment);
+        concatenate(freqs_bits, m_a.freqs_sequences().bits(), a.freqs,
+                    m_b.freqs_sequences().bits(), b.freqs, a.occurrences,
+                    occurrences + 1);
+        push_pad(freqs_bits, alignment);
+
+        m_stats.merged_lists += 1;
+        m_stats.postings += a.n + b.n;
+    }
+
+    // two single partitions are encoded again as a whole instead, as the
+    // metadata of two partitions would cost more than the copy saves
+    void concatenate(succinct::bit_vector_builder& bvb,
+                     succinct::bit_vector const& a_bv, layout const& a,
+                     succinct::bit_vector const& b_bv, layout const& b,
+                     uint64_t shift, uint64_t universe) {
+        if (a.partitions() > 1 or b.partitions() > 1) {
+            m_stats.copied_bits += sequence_type::concatenate(
+                bvb, a_bv, a, b_bv, b, shift, universe, m_params);
+            return;
+        }
+
+        std::vector<uint64_t> values;
+        values.reserve(a.n + b.n);
+        global_parameters params(m_params);
+        typename sequence_type::enumerator a_enum(a_bv, a.offset, a.universe,
+                                                  a.n, params);
+        typename sequence_type::enumerator b_enum(b_bv, b.offset, b.universe,
+                                                  b.n, params);
+        values.push_back(a_enum.move(0).second);
+        for (uint64_t i = 1; i < a.n; ++i) {
+            values.push_back(a_enum.next().second);
+        }
+        values.push_back(b_enum.move(0).second + shift);
+        for (uint64_t i = 1; i < b.n; ++i) {
+            values.push_back(b_enum.next().second + shift);
+        }
+        sequence_type::write(bvb, values.begin(), universe, values.size(),
+                             m_params, m_conf);
+    }
+
+    // a list of a single index: only the docs change, as their universe does
+    void copy_list(index_type& index, uint64_t i, uint64_t shift,
+                   succinct::bit_vector_builder& docs_bits,
+                   succinct::bit_vector_builder& freqs_bits) {
+        list_layout l = read_list(index, i);
+        write_header(docs_bits, l.occurrences, l.n);
+        m_stats.copied_bits +=
+            sequence_type::rebase(docs_bits, index.docs_sequences().bits(),
+                                  l.docs, shift, m_num_docs, m_params);
+        push_pad(docs_bits, alignment);
+
+        auto freqs_range = index.freqs_sequences().range(m_params, i);
+        sequence_type::append_range(freqs_bits, index.freqs_sequences().bits(),
+                                    freqs_range.first, freqs_range.second);
+        m_stats.copied_bits += freqs_bits.size();
+        m_stats.postings += l.n;
+    }
+
+    index_type& m_a;
+    index_type& m_b;
+    configuration const& m_conf;
+    uint64_t m_num_docs;
+    global_parameters m_params;
+    statistics m_stats;
+};
+
+}  // namespace pvb
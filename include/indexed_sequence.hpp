@@ -151,6 +151,11 @@ struct indexed_sequence {
 #undef ENUMERATOR_METHOD
 #undef ENUMERATOR_VOID_METHOD
 
+        // the sequence, if it is stored as a bitmap, or nullptr
+        compact_ranked_bitvector::enumerator const* bitmap() const {
+            return m_type == ranked_bitvector ? &m_rb_enumerator : nullptr;
+        }
+
         index_type m_type;
         union {
             typename Encoder::enumerator m_th_enumerator;
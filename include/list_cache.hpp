@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "util.hpp"
+
+namespace pvb {
+
+// Cache of decoded posting lists over an Index, with the interface of an
+// index, so that the queries run on it unchanged. The lists of the terms
+// requested at least min_requests times are decoded into plain docid and
+// frequency arrays, kept while they fit in budget_bytes; the least recently
+// (lru) or the least frequently (lfu) requested ones are evicted first. The
+// other terms are served by the enumerators of the Index.
+//
+// The cache can be shared by several threads. The terms are split into
+// shards by their id, each with its own lock, as in result_cache, and a
+// request only takes the lock of its shard to count it and copy the list.
+// The eviction order is not kept: the uses are stamped with a global atomic
+// tick, and the victim of an eviction is the lowest ranked of a few cached
+// lists sampled at random from the shards, so that the eviction is an
+// approximate lru or lfu. An enumerator keeps its list alive, so a list can
+// be evicted while a query is running on it.
+template <typename Index>
+class list_cache {
+public:
+    typedef typename Index::document_enumerator index_enumerator;
+
+    enum class policy { lru, lfu };
+
+    struct parameters {
+        parameters()
+            : budget_bytes(uint64_t(256) << 20)
+            , eviction(policy::lfu)
+            , min_requests(2)
+            , shards(16) {}
+
+        uint64_t budget_bytes;
+        policy eviction;
+        uint64_t min_requests;
+        uint64_t shards;
+    };
+
+    struct statistics {
+        statistics()
+            : hits(0)
+            , misses(0)
+            , admissions(0)
+            , evictions(0)
+            , bytes(0)
+            , decode_time(0) {}
+
+        double hit_rate() const {
+            return hits + misses ? double(hits) / (hits + misses) : 0;
+        }
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t admissions;
+        uint64_t evictions;
+        uint64_t bytes;
+        double decode_time;  // seconds spent decoding admitted lists
+    };
+
+private:
+    struct decoded_list {
+        std::vector<uint32_t> docs;
+        std::vector<uint32_t> freqs;
+    };
+
+    typedef std::shared_ptr<const decoded_list> list_ptr;
+
+public:
+    class document_enumerator {
+    public:
+        void reset() {
+            if (m_list) {
+                m_pos = 0;
+                update();
+            } else {
+                m_enum->reset();
+            }
+        }
+
+        void DS2I_FLATTEN_FUNC next() {
+            if (m_list) {
+                ++m_pos;
+                update();
+            } else {
+                m_enum->next();
+            }
+        }
+
+        // gallops from the current position, then binary searches the last
+        // step
+        void DS2I_FLATTEN_FUNC next_geq(uint64_t lower_bound) {
+            if (!m_list) {
+                m_enum->next_geq(lower_bound);
+                return;
+            }
+            if (lower_bound <= m_docid) return;
+            uint32_t const* docs = m_list->docs.data();
+            uint64_t begin = m_pos;
+            uint64_t step = 1;
+            while (begin + step < m_size and docs[begin + step] < lower_bound) {
+                begin += step;
+                step *= 2;
+            }
+            uint64_t end = std::min(begin + step, m_size);
+            m_pos = std::lower_bound(docs + begin + 1, docs + end,
+                                     lower_bound) -
+                    docs;
+            update();
+        }
+
+        // the decoded lists are not prefetched
+        void prefetch_geq(uint64_t lower_bound) const {
+            if (!m_list) m_enum->prefetch_geq(lower_bound);
+        }
+
+        uint64_t docid() const {
+            return m_list ? m_docid : m_enum->docid();
+        }
+
+        uint64_t DS2I_FLATTEN_FUNC freq() {
+            return m_list ? m_list->freqs[m_pos] : m_enum->freq();
+        }
+
+        uint64_t size() const {
+            return m_size;
+        }
+
+        // next_geq gallops to any posting of a decoded list
+        uint64_t num_partitions() const {
+            return m_list ? m_size : m_enum->num_partitions();
+        }
+
+    private:
+        friend class list_cache;
+
+        document_enumerator(list_ptr list, uint64_t num_docs)
+            : m_list(std::move(list))
+            , m_num_docs(num_docs)
+            , m_size(m_list->docs.size())
+            , m_pos(0) {
+            update();
+        }
+
+        document_enumerator(index_enumerator e, uint64_t num_docs)
+            : m_enum(std::move(e))
+            , m_num_docs(num_docs)
+            , m_size(m_enum->size())
+            , m_pos(0)
+            , m_docid(0) {}
+
+        void update() {
+            m_docid = m_pos < m_size ? m_list->docs[m_pos] : m_num_docs;
+        }
+
+        list_ptr m_list;
+        // if not cached; stored inline, so that opening a list that is not
+        // cached costs no allocation
+        boost::optional<index_enumerator> m_enum;
+        uint64_t m_num_docs;
+        uint64_t m_size;
+        uint64_t m_pos;
+        uint64_t m_docid;
+    };
+
+    list_cache(Index& index, parameters const& params = parameters())
+        : m_index(index)
+        , m_params(params)
+        , m_shards(std::max<uint64_t>(1, params.shards))
+        , m_tick(0)
+        , m_bytes(0) {}
+
+    uint64_t size() const {
+        return m_index.size();
+    }
+
+    uint64_t num_docs() const {
+        return m_index.num_docs();
+    }
+
+    document_enumerator operator[](size_t i) {
+        auto& s = shard_of(i);
+        uint64_t tick = m_tick.fetch_add(1, std::memory_order_relaxed) + 1;
+        bool admit;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto& term = s.terms[i];
+            term.requests += 1;
+            term.last_use = tick;
+            if (term.list) {
+                s.stats.hits += 1;
+                return document_enumerator(term.list, num_docs());
+            }
+            s.stats.misses += 1;
+            admit = term.requests >= m_params.min_requests;
+        }
+
+        auto e = m_index[i];
+        uint64_t bytes = 2 * sizeof(uint32_t) * e.size();
+        if (!admit or bytes > m_params.budget_bytes) {
+            return document_enumerator(std::move(e), num_docs());
+        }
+
+        // decoded without holding any lock; if another thread admits the
+        // list meanwhile, its copy is kept
+        double start = get_time_usecs();
+        std::shared_ptr<decoded_list> list(new decoded_list);
+        list->docs.resize(e.size());
+        list->freqs.resize(e.size());
+        std::vector<uint64_t> scan_metadata;
+        open_scan(e, scan_metadata);
+        for (uint64_t j = 0; j < e.size(); ++j, e.next()) {
+            list->docs[j] = e.docid();
+            list->freqs[j] = e.freq();
+        }
+        double elapsed = (get_time_usecs() - start) / 1000000;
+
+        // the bytes are reserved before the list is admitted, so that the
+        // budget holds with concurrent admissions; if nothing is left to
+        // evict, the other reservations are for lists still being admitted,
+        // and this list is served without being cached
+        bool reserved = reserve(bytes);
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.stats.decode_time += elapsed;
+        auto& term = s.terms[i];
+        if (term.list or !reserved) {
+            if (reserved) {
+                m_bytes.fetch_sub(bytes);
+            }
+            return document_enumerator(term.list ? term.list : list,
+                                       num_docs());
+        }
+        term.list = list;
+        term.bytes = bytes;
+        term.slot = s.cached.size();
+        s.cached.push_back(i);
+        s.stats.admissions += 1;
+        return document_enumerator(term.list, num_docs());
+    }
+
+    void warmup(size_t i) const {
+        m_index.warmup(i);
+    }
+
+    statistics stats() const {
+        statistics stats;
+        for (auto const& s : m_shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            stats.hits += s.stats.hits;
+            stats.misses += s.stats.misses;
+            stats.admissions += s.stats.admissions;
+            stats.evictions += s.stats.evictions;
+            stats.decode_time += s.stats.decode_time;
+        }
+        stats.bytes = m_bytes.load();
+        return stats;
+    }
+
+private:
+    // cached lists compared at each eviction
+    static const uint64_t eviction_samples = 8;
+
+    struct term_entry {
+        term_entry() : requests(0), last_use(0), bytes(0), slot(0) {}
+
+        uint64_t requests;
+        uint64_t last_use;
+        uint64_t bytes;
+        size_t slot;  // position in the cached terms of the shard
+        list_ptr list;
+    };
+
+    struct shard {
+        mutable std::mutex mutex;
+        // every term of the shard requested so far, so that the request
+        // counts of the terms not cached are kept for admission and lfu
+        // eviction
+        std::unordered_map<size_t, term_entry> terms;
+        std::vector<size_t> cached;  // in no particular order
+        statistics stats;            // the bytes are kept in m_bytes
+    };
+
+    // the cached lists are evicted in increasing rank
+    typedef std::pair<uint64_t, uint64_t> rank_type;
+
+    rank_type rank(term_entry const& term) const {
+        if (m_params.eviction == policy::lfu) {
+            return rank_type(term.requests, term.last_use);
+        }
+        return rank_type(term.last_use, 0);
+    }
+
+    shard& shard_of(size_t i) {
+        return m_shards[i % m_shards.size()];
+    }
+
+    // adds bytes to the cached ones, evicting lists until they fit in the
+    // budget; false if they do not fit and nothing is cached
+    bool reserve(uint64_t bytes) {
+        uint64_t used = m_bytes.load();
+        do {
+            while (used + bytes > m_params.budget_bytes) {
+                if (!evict()) return false;
+                used = m_bytes.load();
+            }
+        } while (!m_bytes.compare_exchange_weak(used, used + bytes));
+        return true;
+    }
+
+    // evicts the lowest ranked of the cached lists sampled from random
+    // shards, locked one at a time; false if no list is cached
+    bool evict() {
+        static thread_local std::minstd_rand rng;
+        size_t victim_shard = m_shards.size();
+        size_t victim = 0;
+        rank_type victim_rank;
+        auto sample = [&](size_t sh) {
+            auto& s = m_shards[sh];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.cached.empty()) return;
+            size_t i = s.cached[rng() % s.cached.size()];
+            auto r = rank(s.terms[i]);
+            if (victim_shard == m_shards.size() or r < victim_rank) {
+                victim_shard = sh;
+                victim = i;
+                victim_rank = r;
+            }
+        };
+        for (uint64_t k = 0; k < eviction_samples; ++k) {
+            sample(rng() % m_shards.size());
+        }
+        // with few lists cached, the samples may all miss them
+        for (size_t sh = 0; sh < m_shards.size(); ++sh) {
+            if (victim_shard != m_shards.size()) break;
+            sample(sh);
+        }
+        if (victim_shard == m_shards.size()) return false;
+
+        // the victim may have been evicted by another thread meanwhile,
+        // which freed some bytes anyway
+        auto& s = m_shards[victim_shard];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto& term = s.terms[victim];
+        if (term.list) {
+            m_bytes.fetch_sub(term.bytes);
+            s.stats.evictions += 1;
+            term.list.reset();
+            s.cached[term.slot] = s.cached.back();
+            s.terms[s.cached[term.slot]].slot = term.slot;
+            s.cached.pop_back();
+        }
+        return true;
+    }
+
+    Index& m_index;
+    parameters m_params;
+    std::vector<shard> m_shards;
+    std::atomic<uint64_t> m_tick;
+    std::atomic<uint64_t> m_bytes;
+};
+
+template <typename Index>
+const uint64_t list_cache<Index>::eviction_samples;
+
+}  // namespace pvb
@@ -8,8 +8,8 @@
 namespace pvb {
 
 struct opt_vbyte {
-    typedef partitioned_vb_sequence<maskedvbyte_block> docs_sequence_type;
-    typedef positive_sequence<partitioned_vb_sequence<maskedvbyte_block> >
+    typedef partitioned_vb_sequence<maskedvbyte_block<>> docs_sequence_type;
+    typedef positive_sequence<partitioned_vb_sequence<maskedvbyte_block<>> >
         freqs_sequence_type;
 
     static void encode(uint32_t const* in, uint32_t universe, uint32_t n,
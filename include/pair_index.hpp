@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "succinct/mappable_vector.hpp"
+
+#include "configuration.hpp"
+#include "global_parameters.hpp"
+#include "queries.hpp"
+
+namespace pvb {
+
+// Intersections of the lists of pairs of terms, stored as the lists of an
+// Index of the same type as the main one (with all the frequencies set to 1),
+// so that they are encoded the same way and their enumerators can be
+// intersected with those of the main index. The pairs are kept sorted by
+// pair_key; a pair whose lists do not intersect has no list, but is stored
+// all the same so that the queries containing it are answered at once.
+template <typename Index>
+class pair_index {
+public:
+    typedef typename Index::document_enumerator document_enumerator;
+    static const uint32_t empty = uint32_t(-1);
+
+    class builder {
+    public:
+        builder(uint64_t num_docs, global_parameters const& params)
+            : m_num_docs(num_docs), m_params(params) {}
+
+        // docs is the intersection of the lists of a and b
+        void add_pair(uint32_t a, uint32_t b, std::vector<uint32_t> docs) {
+            m_pairs.push_back(pair{pair_key(a, b), std::move(docs)});
+        }
+
+        void build(pair_index& pairs, configuration const& conf) {
+            std::sort(m_pairs.begin(), m_pairs.end(),
+                      [](pair const& lhs, pair const& rhs) {
+                          return lhs.key < rhs.key;
+                      });
+            std::vector<uint64_t> keys;
+            std::vector<uint32_t> list_ids;
+            uint64_t max_size = 0;
+            for (auto const& p : m_pairs) {
+                max_size = std::max<uint64_t>(max_size, p.docs.size());
+            }
+            std::vector<uint32_t> ones(max_size, 1);
+
+            typename Index::builder lists_builder(m_num_docs, m_params);
+            uint32_t lists = 0;
+            for (auto const& p : m_pairs) {
+                keys.push_back(p.key);
+                if (p.docs.empty()) {
+                    list_ids.push_back(empty);
+                    continue;
+                }
+                lists_builder.add_posting_list(p.docs.size(), p.docs.data(),
+                                               ones.data(), p.docs.size(),
+                                               conf);
+                list_ids.push_back(lists++);
+            }
+            lists_builder.build(pairs.m_lists);
+            pairs.m_keys.steal(keys);
+            pairs.m_list_ids.steal(list_ids);
+        }
+
+    private:
+        struct pair {
+            uint64_t key;
+            std::vector<uint32_t> docs;
+        };
+
+        uint64_t m_num_docs;
+        global_parameters m_params;
+        std::vector<pair> m_pairs;
+    };
+
+    static uint64_t pair_key(uint32_t a, uint32_t b) {
+        if (a > b) std::swap(a, b);
+        return (uint64_t(a) << 32) | b;
+    }
+
+    // number of pairs
+    uint64_t size() const {
+        return m_keys.size();
+    }
+
+    // whether the pair (a, b) is stored, and if so the id of its list in
+    // list_id, or empty
+    bool find(uint32_t a, uint32_t b, uint32_t& list_id) const {
+        uint64_t key = pair_key(a, b);
+        auto begin = m_keys.begin();
+        auto it = std::lower_bound(begin, m_keys.end(), key);
+        if (it == m_keys.end() or *it != key) return false;
+        list_id = m_list_ids[it - begin];
+        return true;
+    }
+
+    document_enumerator list(uint32_t list_id) {
+        return m_lists[list_id];
+    }
+
+    Index const& lists() const {
+        return m_lists;
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit) {
+        visit(m_keys, "m_keys")(m_list_ids, "m_list_ids")(m_lists, "m_lists");
+    }
+
+private:
+    succinct::mapper::mappable_vector<uint64_t> m_keys;
+    succinct::mapper::mappable_vector<uint32_t> m_list_ids;
+    Index m_lists;
+};
+
+template <typename Index>
+const uint32_t pair_index<Index>::empty;
+
+// and_query rewritten with the intersections of a pair_index: the lists of
+// the pairs of query terms whose intersection is stored are replaced by it,
+// taking the shortest intersections first, as long as their terms are not
+// already covered by another pair.
+template <typename Index>
+struct pair_and_query {
+    typedef typename Index::document_enumerator enum_type;
+
+    pair_and_query(pair_index<Index>& pairs) : m_pairs(&pairs) {}
+
+    uint64_t operator()(Index& index, term_id_vec terms) const {
+        if (terms.empty()) {
+            return 0;
+        }
+        remove_duplicate_terms(terms);
+
+        std::vector<enum_type> enums;
+        if (!rewrite(index, terms, enums)) {
+            return 0;
+        }
+        return and_query::intersect(enums, index.num_docs());
+    }
+
+    // number of pair lists the query is rewritten with (1 if it is answered
+    // by an empty intersection)
+    uint64_t pairs_used(Index& index, term_id_vec terms) const {
+        remove_duplicate_terms(terms);
+        std::vector<enum_type> enums;
+        uint64_t terms_lists = 0;
+        if (!rewrite(index, terms, enums, &terms_lists)) {
+            return 1;
+        }
+        return enums.size() - terms_lists;
+    }
+
+private:
+    // fills enums with the pair and term lists of the query, and returns
+    // false if a pair of its terms has an empty intersection
+    bool rewrite(Index& index, term_id_vec const& terms,
+                 std::vector<enum_type>& enums,
+                 uint64_t* terms_lists = nullptr) const {
+        std::vector<std::pair<enum_type, std::pair<size_t, size_t>>> pairs;
+        for (size_t i = 0; i < terms.size(); ++i) {
+            for (size_t j = i + 1; j < terms.size(); ++j) {
+                uint32_t list_id;
+                if (!m_pairs->find(terms[i], terms[j], list_id)) continue;
+                if (list_id == pair_index<Index>::empty) return false;
+                pairs.emplace_back(m_pairs->list(list_id),
+                                   std::make_pair(i, j));
+            }
+        }
+        std::sort(pairs.begin(), pairs.end(),
+                  [](auto const& lhs, auto const& rhs) {
+                      return lhs.first.size() < rhs.first.size();
+                  });
+
+        std::vector<bool> covered(terms.size(), false);
+        enums.reserve(terms.size());
+        for (auto& p : pairs) {
+            size_t i = p.second.first, j = p.second.second;
+            if (covered[i] or covered[j]) continue;
+            covered[i] = covered[j] = true;
+            enums.push_back(std::move(p.first));
+        }
+        for (size_t i = 0; i < terms.size(); ++i) {
+            if (!covered[i]) {
+                enums.push_back(index[terms[i]]);
+                if (terms_lists) *terms_lists += 1;
+            }
+        }
+        return true;
+    }
+
+    pair_index<Index>* m_pairs;
+};
+
+}  // namespace pvb
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <numeric>
+
+#include "block_codecs.hpp"
+#include "compact_elias_fano.hpp"
+#include "configuration.hpp"
+#include "global_parameters.hpp"
+#include "integer_codes.hpp"
+#include "unary_enumerator.hpp"
+#include "util.hpp"
+
+namespace pvb {
+
+// Frequencies sequence, to be used in place of positive_sequence: since most
+// frequencies are 1, runs of at least min_ones_run ones are encoded
+// implicitly, as in all_ones_sequence, and the other values are split in
+// partitions of at most block_size values. Each partition is encoded either
+// with streamvbyte_0124_block (values minus one, so a 1 costs only its 2-bit
+// code) or in unary (the bitmap of the prefix sums, as a ranked bitvector
+// partition of positive_sequence would), whichever is smaller.
+//
+// The universe must be the sum of the frequencies plus one, as passed by
+// freq_index: a list made only of ones takes no space at all. Otherwise the
+// layout is the number of partitions P and, if P > 1, the partition ends
+// (compact_elias_fano, P - 1 values) followed by the end offsets in bytes of
+// the partitions data, shifted left by one to make room for the partition
+// type (P values of endpoint_bits bits). The runs of ones are the partitions
+// with empty data. If P == 1 only the type is written.
+struct partitioned_freqs_sequence {
+    typedef streamvbyte_0124_block<> codec_type;
+    static const uint64_t block_size = codec_type::block_size;
+    static const uint64_t min_ones_run = 64;
+
+    enum partition_type { vbyte = 0, unary = 1 };
+
+    template <typename Iterator>
+    static void write(succinct::bit_vector_builder& bvb, Iterator begin,
+                      uint64_t universe, uint64_t n,
+                      global_parameters const& params,
+                      configuration const& conf) {
+        assert(n > 0);
+        (void)conf;
+        if (universe == n + 1) {
+            return;  // all ones
+        }
+
+        std::vector<uint32_t> values(n);
+        auto it = begin;
+        for (uint64_t i = 0; i < n; ++i, ++it) {
+            assert(*it > 0);
+            values[i] = *it - 1;
+        }
+
+        std::vector<uint64_t> sizes;
+        std::vector<uint64_t> endpoints;
+        std::vector<uint8_t> data;
+        uint64_t coded_begin = 0;
+
+        std::vector<uint8_t> buf;
+        auto encode_values = [&](uint64_t end) {
+            while (coded_begin < end) {
+                uint64_t block = std::min(end - coded_begin, block_size);
+                uint32_t const* in = values.data() + coded_begin;
+                buf.clear();
+                codec_type::encode(in, 0, block, buf);
+                uint64_t unary_bits = std::accumulate(in, in + block, block);
+                int type = vbyte;
+                if (succinct::util::ceil_div(unary_bits, 8) < buf.size()) {
+                    type = unary;
+                    buf.assign(succinct::util::ceil_div(unary_bits, 8), 0);
+                    for (uint64_t i = 0, pos = 0; i < block; ++i) {
+                        pos += in[i];
+                        buf[pos / 8] |= 1 << (pos % 8);
+                        pos += 1;
+                    }
+                }
+                data.insert(data.end(), buf.begin(), buf.end());
+                coded_begin += block;
+                sizes.push_back(coded_begin);
+                endpoints.push_back(data.size() << 1 | type);
+            }
+        };
+
+        for (uint64_t i = 0; i < n;) {
+            if (values[i]) {
+                ++i;
+                continue;
+            }
+            uint64_t run_end = i + 1;
+            while (run_end < n and !values[run_end]) {
+                ++run_end;
+            }
+            if (run_end - i >= min_ones_run) {
+                encode_values(i);
+                sizes.push_back(run_end);
+                endpoints.push_back(data.size() << 1);
+                coded_begin = run_end;
+            }
+            i = run_end;
+        }
+        encode_values(n);
+
+        uint64_t partitions = sizes.size();
+        assert(sizes.back() == n);
+        write_gamma_nonzero(bvb, partitions);
+        if (partitions == 1) {
+            bvb.append_bits(endpoints.front() & 1, 1);
+        } else {
+            succinct::bit_vector_builder bv_sizes;
+            compact_elias_fano::write(bv_sizes, sizes.begin(), n,
+                                      partitions - 1, params);
+            uint64_t endpoint_bits = ceil_log2(endpoints.back() + 2);
+            write_gamma(bvb, endpoint_bits);
+            bvb.append(bv_sizes);
+            for (uint64_t endpoint : endpoints) {
+                bvb.append_bits(endpoint, endpoint_bits);
+            }
+        }
+
+        push_pad(bvb);
+        for (uint8_t v : data) {
+            bvb.append_bits(v, 8);
+        }
+    }
+
+    class enumerator {
+    public:
+        typedef std::pair<uint64_t, uint64_t> value_type;  // (position, value)
+
+        enumerator() {}
+
+        enumerator(succinct::bit_vector const& bv, uint64_t offset,
+                   uint64_t universe, uint64_t n, global_parameters& params)
+            : m_size(n)
+            , m_partitions(1)
+            , m_cur_begin(0)
+            , m_cur_end(0)
+            , m_cur_ones(false)
+            , m_bv(&bv) {
+            if (universe == n + 1) {
+                m_cur_end = n;
+                m_cur_ones = true;
+                return;
+            }
+
+            succinct::bit_vector::enumerator it(bv, offset);
+            m_partitions = read_gamma_nonzero(it);
+            if (m_partitions == 1) {
+                m_type = partition_type(it.take(1));
+            } else {
+                m_endpoint_bits = read_gamma(it);
+                m_sizes = compact_elias_fano::enumerator(
+                    bv, it.position(), n, m_partitions - 1, params);
+                m_endpoints_offset =
+                    it.position() +
+                    compact_elias_fano::bitsize(params, n, m_partitions - 1);
+                it = succinct::bit_vector::enumerator(
+                    bv,
+                    m_endpoints_offset + m_endpoint_bits * m_partitions);
+            }
+            eat_pad(it);
+            m_data_offset = it.position();
+        }
+
+        value_type DS2I_ALWAYSINLINE move(uint64_t position) {
+            assert(position < size());
+            uint64_t i = position - m_cur_begin;
+            if (DS2I_LIKELY(i < m_cur_end - m_cur_begin)) {
+                return value_type(position, m_cur_ones ? 1 : m_buffer[i]);
+            }
+            return slow_move(position);
+        }
+
+        uint64_t size() const {
+            return m_size;
+        }
+
+    private:
+        value_type DS2I_NOINLINE slow_move(uint64_t position) {
+            uint64_t data_begin = 0;
+            uint64_t data_end = 0;
+            if (m_partitions == 1) {
+                m_cur_begin = 0;
+                m_cur_end = m_size;
+            } else {
+                auto size_it = m_sizes.next_geq(position + 1);
+                uint64_t partition = size_it.first;
+                m_cur_end = size_it.second;
+                m_cur_begin = m_sizes.prev_value();
+                if (partition) {
+                    data_begin = endpoint(partition - 1) >> 1;
+                }
+                uint64_t e = endpoint(partition);
+                data_end = e >> 1;
+                m_type = partition_type(e & 1);
+            }
+
+            m_cur_ones = m_partitions > 1 and data_begin == data_end;
+            if (!m_cur_ones) {
+                decode(m_data_offset + 8 * data_begin, m_cur_end - m_cur_begin);
+            }
+            return move(position);
+        }
+
+        void decode(uint64_t offset, uint64_t n) {
+            if (m_type == unary) {
+                unary_enumerator ones(*m_bv, offset);
+                uint64_t last = offset;
+                for (uint64_t i = 0; i < n; ++i) {
+                    uint64_t pos = ones.next() + 1;
+                    m_buffer[i] = pos - last;
+                    last = pos;
+                }
+            } else {
+                auto data =
+                    reinterpret_cast<uint8_t const*>(m_bv->data().data());
+                codec_type::decode(data + offset / 8, m_buffer, 0, n);
+                for (uint64_t i = 0; i < n; ++i) {
+                    m_buffer[i] += 1;
+                }
+            }
+        }
+
+        uint64_t endpoint(uint64_t partition) const {
+            return m_bv->get_word56(m_endpoints_offset +
+                                    partition * m_endpoint_bits) &
+                   ((uint64_t(1) << m_endpoint_bits) - 1);
+        }
+
+        uint64_t m_size;
+        uint64_t m_partitions;
+        uint64_t m_endpoint_bits;
+        uint64_t m_endpoints_offset;
+        uint64_t m_cur_begin;
+        uint64_t m_cur_end;
+        bool m_cur_ones;
+        partition_type m_type;
+
+        succinct::bit_vector const* m_bv;
+        uint64_t m_data_offset;
+        compact_elias_fano::enumerator m_sizes;
+        uint32_t m_buffer[block_size];
+    };
+};
+}  // namespace pvb
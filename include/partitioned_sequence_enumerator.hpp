@@ -3,6 +3,7 @@
 #include "configuration.hpp"
 #include "global_parameters.hpp"
 #include "compact_elias_fano.hpp"
+#include "compact_ranked_bitvector.hpp"
 #include "integer_codes.hpp"
 #include "util.hpp"
 #include "typedefs.hpp"
@@ -114,6 +115,26 @@ struct partitioned_sequence_enumerator {
         return slow_next_geq(lower_bound);
     }
 
+    // Prefetches what a next_geq(lower_bound) leaving the current partition
+    // reads first: the data of the next partition, where the lagging lists
+    // of an intersection land most of the time, and its upper bound in the
+    // decoded metadata if any. Nothing is moved.
+    void DS2I_ALWAYSINLINE prefetch_geq(uint64_t lower_bound) const {
+        if (DS2I_LIKELY(lower_bound <= m_cur_upper_bound)) return;
+        uint64_t partition = m_cur_partition + 1;
+        if (partition >= m_partitions) return;
+
+        uint64_t endpoint =
+            m_bv->get_word56(m_endpoints_offset +
+                             (partition - 1) * m_endpoint_bits) &
+            ((uint64_t(1) << m_endpoint_bits) - 1);
+        m_bv->data().prefetch((m_sequences_offset + endpoint) / 64);
+        if (m_scan_metadata) {
+            succinct::intrinsics::prefetch(m_scan_metadata + m_partitions +
+                                           partition + 1);
+        }
+    }
+
     pv_type DS2I_ALWAYSINLINE next() {
         ++m_position;
         if (DS2I_LIKELY(m_position < m_cur_end)) {
@@ -127,6 +148,29 @@ struct partitioned_sequence_enumerator {
         return m_size;
     }
 
+    uint64_t num_partitions() const {
+        return m_partitions;
+    }
+
+    // the docids of the current partition are in [partition_base(),
+    // partition_upper_bound()], and the positions before partition_end()
+    uint64_t partition_base() const {
+        return m_cur_base;
+    }
+
+    uint64_t partition_upper_bound() const {
+        return m_cur_upper_bound;
+    }
+
+    uint64_t partition_end() const {
+        return m_cur_end;
+    }
+
+    // the current partition, if it is stored as a bitmap, or nullptr
+    compact_ranked_bitvector::enumerator const* partition_bitmap() const {
+        return m_partition_enum.bitmap();
+    }
+
     pv_type DS2I_NOINLINE slow_next() {
         if (DS2I_UNLIKELY(m_position == m_size)) {
             assert(m_cur_partition == m_partitions - 1);
@@ -136,7 +180,7 @@ struct partitioned_sequence_enumerator {
             return pv_type(m_position, m_universe);
         }
 
-        switch_partition(m_cur_partition + 1);
+        next_partition();
         uint64_t doc = m_partition_enum.move(0).second;
         uint64_t val = m_cur_base + doc;
 
@@ -213,30 +257,52 @@ struct partitioned_sequence_enumerator {
             m_cur_end - m_cur_begin, *m_params);
     }
 
-    // void next_partition()
-    // {
-    //     uint64_t endpoint = m_bv->get_word56(m_endpoints_offset +
-    //     m_cur_partition * m_endpoint_bits)
-    //              & ((uint64_t(1) << m_endpoint_bits) - 1);
+    // Opens the enumerator for a full scan, which visits the partitions in
+    // order: for long lists, all the sizes and upper bounds are decoded at
+    // once into metadata, and next() reads them from there afterwards
+    // instead of moving m_sizes and m_upper_bounds (whose prev_value() goes
+    // back through the bitvector). The enumerators of the intersections,
+    // which skip most partitions, are not opened this way. metadata must
+    // outlive the enumerator and its copies.
+    void open_scan(std::vector<uint64_t>& metadata) {
+        if (m_partitions < scan_metadata_threshold) return;
+
+        metadata.resize(2 * m_partitions + 1);
+        m_sizes.decode(metadata.data(), m_partitions - 1);
+        metadata[m_partitions - 1] = m_size;
+        m_upper_bounds.decode(metadata.data() + m_partitions,
+                              m_partitions + 1);
+        m_scan_metadata = metadata.data();
+    }
 
-    //     uint64_t partition_begin = m_sequences_offset + endpoint;
+    void next_partition() {
+        uint64_t partition = m_cur_partition + 1;
+        if (!m_scan_metadata) {
+            switch_partition(partition);
+            return;
+        }
 
-    //     auto size_it = m_sizes.next();
-    //     m_cur_end = size_it.second;
-    //     m_cur_begin = m_sizes.prev_value();
+        uint64_t endpoint =
+            m_bv->get_word56(m_endpoints_offset +
+                             (partition - 1) * m_endpoint_bits) &
+            ((uint64_t(1) << m_endpoint_bits) - 1);
 
-    //     auto ub_it = m_upper_bounds.next();
-    //     m_cur_upper_bound = ub_it.second;
-    //     m_cur_base = m_upper_bounds.prev_value() + (m_cur_partition ? 1 : 0);
+        uint64_t partition_begin = m_sequences_offset + endpoint;
+        m_bv->data().prefetch(partition_begin / 64);
 
-    //     m_partition_enum = base_sequence_enumerator
-    //         (*m_bv, partition_begin,
-    //          m_cur_upper_bound - m_cur_base + 1,
-    //          m_cur_end - m_cur_begin,
-    //          *m_params);
+        uint64_t const* sizes = m_scan_metadata;
+        uint64_t const* upper_bounds = sizes + m_partitions;
+        m_cur_partition = partition;
+        m_cur_begin = sizes[partition - 1];
+        m_cur_end = sizes[partition];
+        m_cur_base = upper_bounds[partition] + 1;
+        m_cur_upper_bound = upper_bounds[partition + 1];
+        m_partition_enum = base_sequence_enumerator(
+            *m_bv, partition_begin, m_cur_upper_bound - m_cur_base + 1,
+            m_cur_end - m_cur_begin, *m_params);
+    }
 
-    //     ++m_cur_partition;
-    // }
+    static const uint64_t scan_metadata_threshold = 8;
 
     global_parameters* m_params;
     uint64_t m_partitions;
@@ -257,5 +323,6 @@ struct partitioned_sequence_enumerator {
     compact_elias_fano::enumerator m_sizes;
     compact_elias_fano::enumerator m_upper_bounds;
     base_sequence_enumerator m_partition_enum;
+    uint64_t const* m_scan_metadata = nullptr;
 };
 }  // namespace pvb
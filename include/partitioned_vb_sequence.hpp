@@ -111,6 +111,241 @@ struct partitioned_vb_sequence {
         }
     }
 
+    // Partitions of an encoded sequence. Partition i holds the positions
+    // [sizes[i - 1], sizes[i]) and the values [base(i), upper_bounds[i + 1]],
+    // and its bits are [endpoints[i], endpoints[i + 1]) of the bitvector; the
+    // last endpoint is the end of the sequence given to read_layout, so it
+    // may include some padding.
+    struct layout {
+        uint64_t offset;
+        uint64_t universe;
+        uint64_t n;
+        std::vector<uint64_t> sizes;
+        std::vector<uint64_t> upper_bounds;
+        std::vector<uint64_t> endpoints;
+
+        uint64_t partitions() const {
+            return sizes.size();
+        }
+
+        uint64_t base(uint64_t i) const {
+            return upper_bounds[i] + (i ? 1 : 0);
+        }
+    };
+
+    static layout read_layout(succinct::bit_vector const& bv, uint64_t offset,
+                              uint64_t end, uint64_t universe, uint64_t n,
+                              global_parameters const& params) {
+        layout l;
+        l.offset = offset;
+        l.universe = universe;
+        l.n = n;
+        succinct::bit_vector::enumerator it(bv, offset);
+        uint64_t partitions = read_gamma_nonzero(it);
+        if (partitions == 1) {
+            uint64_t base = it.take(ceil_log2(universe));
+            uint64_t ub = 0;
+            if (n > 1) {
+                uint64_t universe_delta = read_delta(it);
+                ub = universe_delta ? universe_delta : (universe - base - 1);
+            }
+            eat_pad(it, alignment);
+            l.sizes.push_back(n);
+            l.upper_bounds = {base, base + ub};
+            l.endpoints = {it.position(), end};
+            return l;
+        }
+
+        global_parameters p(params);
+        uint64_t endpoint_bits = read_gamma(it);
+        uint64_t cur_offset = it.position();
+        compact_elias_fano::enumerator sizes(bv, cur_offset, n, partitions - 1,
+                                             p);
+        cur_offset += compact_elias_fano::bitsize(p, n, partitions - 1);
+        compact_elias_fano::enumerator upper_bounds(bv, cur_offset, universe,
+                                                    partitions + 1, p);
+        cur_offset += compact_elias_fano::bitsize(p, universe, partitions + 1);
+        uint64_t endpoints_offset = cur_offset;
+        cur_offset += endpoint_bits * (partitions - 1);
+        uint64_t sequences_offset =
+            succinct::util::ceil_div(cur_offset, alignment) * alignment;
+
+        for (uint64_t i = 0; i < partitions - 1; ++i) {
+            l.sizes.push_back(sizes.move(i).second);
+        }
+        l.sizes.push_back(n);
+        for (uint64_t i = 0; i <= partitions; ++i) {
+            l.upper_bounds.push_back(upper_bounds.move(i).second);
+        }
+        l.endpoints.push_back(sequences_offset);
+        for (uint64_t i = 0; i < partitions - 1; ++i) {
+            l.endpoints.push_back(
+                sequences_offset +
+                bv.get_bits(endpoints_offset + i * endpoint_bits,
+                            endpoint_bits));
+        }
+        l.endpoints.push_back(end);
+        return l;
+    }
+
+    // Writes the sequence made of the values of a followed by those of b
+    // increased by shift, which must be larger than the values of a. The
+    // partitions are copied bit by bit, and only their metadata is rebased:
+    // the exception is the first partition of b, whose base becomes the last
+    // value of a plus one, and which is encoded again if it is a bitmap.
+    // Returns the number of bits copied as they are.
+    static uint64_t concatenate(succinct::bit_vector_builder& bvb,
+                                succinct::bit_vector const& a_bv,
+                                layout const& a,
+                                succinct::bit_vector const& b_bv,
+                                layout const& b, uint64_t shift,
+                                uint64_t universe,
+                                global_parameters const& params) {
+        uint64_t a_partitions = a.partitions();
+        uint64_t b_partitions = b.partitions();
+        uint64_t partitions = a_partitions + b_partitions;
+        uint64_t a_last = a.upper_bounds.back();
+        assert(b.upper_bounds.front() + shift > a_last);
+        assert(a.endpoints.front() % alignment == 0);
+
+        std::vector<uint64_t> sizes(a.sizes);
+        std::vector<uint64_t> upper_bounds(a.upper_bounds);
+        std::vector<uint64_t> endpoints;
+        sizes.reserve(partitions);
+        upper_bounds.reserve(partitions + 1);
+        endpoints.reserve(partitions);
+
+        succinct::bit_vector_builder bv_sequences;
+        for (uint64_t i = 0; i < a_partitions; ++i) {
+            endpoints.push_back(a.endpoints[i] - a.endpoints.front());
+        }
+        append_range(bv_sequences, a_bv, a.endpoints.front(),
+                     a.endpoints.back());
+        uint64_t copied = bv_sequences.size();
+
+        // first partition of b, with the new base: the VByte blocks are a
+        // plain stream of VByte codes, so only the code of the first gap
+        // changes, while a bitmap is re-encoded
+        uint64_t base = a_last + 1;
+        uint64_t b_begin = b.endpoints[0];
+        uint64_t b_end = b.endpoints[1];
+        endpoints.push_back(bv_sequences.size());
+        if (b_bv.get_bits(b_begin, type_bits) == uint64_t(VBBlock::type)) {
+            uint64_t data = b_begin + alignment;  // type bit and padding
+            uint64_t code_end = data;
+            while (b_bv.get_bits(code_end, 8) & 0x80) {
+                code_end += 8;
+            }
+            code_end += 8;
+            uint32_t gap = b.upper_bounds.front() + shift - base + 1;
+            std::vector<uint8_t> code;
+            VBBlock::encode(&gap, gap, 1, code);
+
+            bv_sequences.append_bits(VBBlock::type, type_bits);
+            push_pad(bv_sequences);
+            for (uint8_t v : code) {
+                bv_sequences.append_bits(v, 8);
+            }
+            append_range(bv_sequences, b_bv, code_end, b_end);
+            copied += b_end - code_end;
+        } else {
+            std::vector<uint64_t> values;
+            values.reserve(b.sizes.front());
+            global_parameters p(params);
+            enumerator e(b_bv, b.offset, b.universe, b.n, p);
+            values.push_back(e.move(0).second + shift);
+            for (uint64_t i = 1; i < b.sizes.front(); ++i) {
+                values.push_back(e.next().second + shift);
+            }
+            // from the new base a bitmap also spans the gap after a_last,
+            // so the cheaper encoding is written, as in indexed_sequence
+            uint64_t n = values.size();
+            uint64_t vb_cost =
+                VBBlock::bitsize(values.begin(), params, 0, n, base);
+            uint64_t rb_cost =
+                RBBlock::bitsize(params, values.back() + 1 - base, n);
+            int type = vb_cost < rb_cost ? VBBlock::type : RBBlock::type;
+            write_block(bv_sequences, values.begin(), type, base,
+                        values.back() + 1, n, params);
+        }
+        sizes.push_back(a.n + b.sizes.front());
+        upper_bounds.push_back(b.upper_bounds[1] + shift);
+
+        // the other partitions of b keep their alignment, as the padding of
+        // the VByte blocks depends on it
+        if (b_partitions > 1) {
+            uint64_t begin = b.endpoints[1];
+            uint64_t pad = (begin - bv_sequences.size()) % alignment;
+            bv_sequences.zero_extend(pad);
+            uint64_t new_begin = bv_sequences.size();
+            for (uint64_t i = 1; i < b_partitions; ++i) {
+                endpoints.push_back(b.endpoints[i] - begin + new_begin);
+                sizes.push_back(a.n + b.sizes[i]);
+                upper_bounds.push_back(b.upper_bounds[i + 1] + shift);
+            }
+            append_range(bv_sequences, b_bv, begin, b.endpoints.back());
+            copied += b.endpoints.back() - begin;
+        }
+
+        assert(sizes.size() == partitions);
+        assert(upper_bounds.size() == partitions + 1);
+        write_partitions(bvb, a.n + b.n, universe, sizes, upper_bounds,
+                         endpoints, bv_sequences, params);
+        return copied;
+    }
+
+    // Writes the sequence of l with its values increased by shift and the new
+    // universe, copying all the partitions as they are. Returns the number of
+    // bits copied.
+    static uint64_t rebase(succinct::bit_vector_builder& bvb,
+                           succinct::bit_vector const& bv, layout const& l,
+                           uint64_t shift, uint64_t universe,
+                           global_parameters const& params) {
+        uint64_t begin = l.endpoints.front();
+        uint64_t end = l.endpoints.back();
+        assert(begin % alignment == 0);
+        if (l.partitions() == 1) {
+            uint64_t base = l.upper_bounds.front() + shift;
+            uint64_t relative_universe = l.upper_bounds.back() - l.base(0);
+            write_gamma_nonzero(bvb, 1);
+            bvb.append_bits(base, ceil_log2(universe));
+            if (l.n > 1) {
+                if (base + relative_universe + 1 == universe) {
+                    write_delta(bvb, 0);  // tight universe
+                } else {
+                    write_delta(bvb, relative_universe);
+                }
+            }
+            push_pad(bvb);
+            append_range(bvb, bv, begin, end);
+            return end - begin;
+        }
+
+        std::vector<uint64_t> upper_bounds(l.upper_bounds);
+        std::vector<uint64_t> endpoints;
+        for (auto& ub : upper_bounds) {
+            ub += shift;
+        }
+        for (uint64_t i = 0; i < l.partitions(); ++i) {
+            endpoints.push_back(l.endpoints[i] - begin);
+        }
+        succinct::bit_vector_builder bv_sequences;
+        append_range(bv_sequences, bv, begin, end);
+        write_partitions(bvb, l.n, universe, l.sizes, upper_bounds, endpoints,
+                         bv_sequences, params);
+        return end - begin;
+    }
+
+    // appends the bits [begin, end) of bv
+    static void append_range(succinct::bit_vector_builder& bvb,
+                             succinct::bit_vector const& bv, uint64_t begin,
+                             uint64_t end) {
+        for (; begin + 64 <= end; begin += 64) {
+            bvb.append_bits(bv.get_bits(begin, 64), 64);
+        }
+        bvb.append_bits(bv.get_bits(begin, end - begin), end - begin);
+    }
+
     // static void decode(succinct::bit_vector const& bv,
     //                    uint32_t* out, uint64_t offset,
     //                    uint64_t universe, uint64_t n)
@@ -141,6 +376,36 @@ struct partitioned_vb_sequence {
 private:
     static const uint64_t type_bits = indexed_sequence<>::type_bits;
 
+    // the metadata of a sequence with more than one partition, followed by
+    // the partitions
+    static void write_partitions(succinct::bit_vector_builder& bvb,
+                                 uint64_t n, uint64_t universe,
+                                 std::vector<uint64_t> const& sizes,
+                                 std::vector<uint64_t> const& upper_bounds,
+                                 std::vector<uint64_t> const& endpoints,
+                                 succinct::bit_vector_builder& bv_sequences,
+                                 global_parameters const& params) {
+        uint64_t partitions = sizes.size();
+        assert(partitions > 1);
+        assert(sizes.back() == n);
+        write_gamma_nonzero(bvb, partitions);
+        succinct::bit_vector_builder bv_sizes;
+        succinct::bit_vector_builder bv_upper_bounds;
+        compact_elias_fano::write(bv_sizes, sizes.begin(), n, partitions - 1,
+                                  params);
+        compact_elias_fano::write(bv_upper_bounds, upper_bounds.begin(),
+                                  universe, partitions + 1, params);
+        uint64_t endpoint_bits = ceil_log2(bv_sequences.size() + 1);
+        write_gamma(bvb, endpoint_bits);
+        bvb.append(bv_sizes);
+        bvb.append(bv_upper_bounds);
+        for (uint64_t i = 1; i < partitions; ++i) {
+            bvb.append_bits(endpoints[i], endpoint_bits);
+        }
+        push_pad(bvb);
+        bvb.append(bv_sequences);
+    }
+
     template <typename Iterator>
     static void write_block(succinct::bit_vector_builder& bvb, Iterator begin,
                             int type, uint64_t base, uint64_t universe,
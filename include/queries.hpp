@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <numeric>
 #include <sstream>
 
 #include "types.hpp"
@@ -49,6 +50,12 @@ struct and_query {
             enums.push_back(index[term]);
         }
 
+        return intersect(enums, index.num_docs());
+    }
+
+    // number of documents in all the lists of enums
+    template <typename Enum>
+    static uint64_t intersect(std::vector<Enum>& enums, uint64_t num_docs) {
         // sort by increasing frequency
         std::sort(enums.begin(), enums.end(),
                   [](auto const& lhs, auto const& rhs) {
@@ -58,7 +65,16 @@ struct and_query {
         uint64_t results = 0;
         uint64_t candidate = enums[0].docid();
         size_t i = 1;
-        while (candidate < index.num_docs()) {
+        while (candidate < num_docs) {
+#ifdef DS2I_PREFETCH_LISTS
+            // the lists after i are moved to candidate next, so their cache
+            // misses overlap with the next_geq of list i. Off by default: when
+            // the decoding dominates the hardware prefetcher already hides
+            // most misses, and the extra checks cost more than they save
+            for (size_t j = i + 1; j < enums.size(); ++j) {
+                enums[j].prefetch_geq(candidate);
+            }
+#endif
             for (; i < enums.size(); ++i) {
                 enums[i].next_geq(candidate);
                 if (enums[i].docid() != candidate) {
@@ -78,6 +94,29 @@ struct and_query {
 
         return results;
     }
+
+    // runs the query on every shard in parallel and sums the results
+    template <typename Index>
+    uint64_t operator()(sharded_index<Index>& index, term_id_vec terms) const {
+        if (terms.empty()) {
+            return 0;
+        }
+        remove_duplicate_terms(terms);
+
+        std::vector<uint64_t> results(index.num_shards(), 0);
+        index.parallel_shards([&](size_t s) {
+            term_id_vec lists;
+            for (auto term : terms) {
+                uint32_t list = index.shard_list(s, term);
+                if (list == sharded_index<Index>::absent) {
+                    return;
+                }
+                lists.push_back(list);
+            }
+            results[s] = (*this)(index.shard(s), lists);
+        });
+        return std::accumulate(results.begin(), results.end(), uint64_t(0));
+    }
 };
 
 struct or_query {
@@ -151,10 +190,6 @@ struct ranked_and_query {
     template <typename Index>
     uint64_t operator()(Index& index, term_id_vec terms) {
         typedef typename Index::document_enumerator enum_type;
-        struct scored_enum {
-            enum_type docs_enum;
-            float q_weight;
-        };
 
         m_topk.clear();
         if (terms.empty()) {
@@ -162,7 +197,7 @@ struct ranked_and_query {
         }
 
         auto query_term_freqs = query_freqs(terms);
-        std::vector<scored_enum> enums;
+        std::vector<scored_enum<enum_type>> enums;
         enums.reserve(query_term_freqs.size());
 
         uint64_t num_docs = index.num_docs();
@@ -170,9 +205,73 @@ struct ranked_and_query {
             auto list = index[term.first];
             auto q_weight = scorer_type::query_term_weight(
                 term.second, list.size(), num_docs);
-            enums.push_back(scored_enum{std::move(list), q_weight});
+            enums.push_back(scored_enum<enum_type>{std::move(list), q_weight});
         }
 
+        intersect(enums, num_docs, m_topk);
+        m_topk.finalize();
+        return m_topk.topk().size();
+    }
+
+    // runs the query on every shard in parallel, with the weights of the
+    // whole collection, and merges the top-k of the shards
+    template <typename Index>
+    uint64_t operator()(sharded_index<Index>& index, term_id_vec terms) {
+        typedef typename Index::document_enumerator enum_type;
+
+        m_topk.clear();
+        if (terms.empty()) {
+            return 0;
+        }
+
+        auto query_term_freqs = query_freqs(terms);
+        uint64_t num_docs = index.num_docs();
+        std::vector<float> q_weights;
+        for (auto term : query_term_freqs) {
+            q_weights.push_back(scorer_type::query_term_weight(
+                term.second, index.list_size(term.first), num_docs));
+        }
+
+        std::vector<scored_data_type> results(index.num_shards());
+        index.parallel_shards([&](size_t s) {
+            std::vector<scored_enum<enum_type>> enums;
+            enums.reserve(query_term_freqs.size());
+            for (size_t i = 0; i < query_term_freqs.size(); ++i) {
+                uint32_t list = index.shard_list(s, query_term_freqs[i].first);
+                if (list == sharded_index<Index>::absent) {
+                    return;
+                }
+                enums.push_back(
+                    scored_enum<enum_type>{index.shard(s)[list], q_weights[i]});
+            }
+            topk_queue<scored_data_type> topk(m_topk.size());
+            intersect(enums, num_docs, topk);
+            results[s] = topk.topk();
+        });
+
+        for (auto const& shard_results : results) {
+            for (auto const& r : shard_results) {
+                m_topk.insert(r.first, r.second);
+            }
+        }
+        m_topk.finalize();
+        return m_topk.topk().size();
+    }
+
+    scored_data_type const& topk() const {
+        return m_topk.topk();
+    }
+
+private:
+    template <typename Enum>
+    struct scored_enum {
+        Enum docs_enum;
+        float q_weight;
+    };
+
+    template <typename Enum>
+    void intersect(std::vector<scored_enum<Enum>>& enums, uint64_t num_docs,
+                   topk_queue<scored_data_type>& topk) const {
         // sort by increasing frequency
         std::sort(enums.begin(), enums.end(),
                   [](auto const& lhs, auto const& rhs) {
@@ -181,7 +280,12 @@ struct ranked_and_query {
 
         uint64_t candidate = enums[0].docs_enum.docid();
         size_t i = 1;
-        while (candidate < index.num_docs()) {
+        while (candidate < num_docs) {
+#ifdef DS2I_PREFETCH_LISTS  // see and_query::intersect
+            for (size_t j = i + 1; j < enums.size(); ++j) {
+                enums[j].docs_enum.prefetch_geq(candidate);
+            }
+#endif
             for (; i < enums.size(); ++i) {
                 enums[i].docs_enum.next_geq(candidate);
                 if (enums[i].docs_enum.docid() != candidate) {
@@ -192,20 +296,111 @@ struct ranked_and_query {
             }
 
             if (i == enums.size()) {
-                float norm_len = m_wdata->norm_len(candidate);
+                float denominator = m_wdata->len_denominator(candidate);
                 float score = 0;
                 for (i = 0; i < enums.size(); ++i) {
                     score += enums[i].q_weight *
-                             scorer_type::doc_term_weight(
-                                 enums[i].docs_enum.freq(), norm_len);
+                             scorer_type::doc_term_weight_denominator(
+                                 enums[i].docs_enum.freq(), denominator);
                 }
 
-                m_topk.insert(score, enums[0].docs_enum.docid());
+                topk.insert(score, enums[0].docs_enum.docid());
                 enums[0].docs_enum.next();
                 candidate = enums[0].docs_enum.docid();
                 i = 1;
             }
         }
+    }
+
+    wand_data<scorer_type> const* m_wdata;
+    topk_queue<scored_data_type> m_topk;
+};
+
+// ranked_and_query skipping the candidates that cannot enter the top-k: the
+// score of a document is at most the sum of the max weights of the blocks
+// of the wand data (built with a block size) that contain it, so when that
+// sum is not above the threshold of the top-k all the docids up to the end
+// of the first of these blocks are skipped, without reading the freqs or
+// scoring them. The results are those of ranked_and_query.
+struct block_max_ranked_and_query {
+    typedef bm25 scorer_type;
+    typedef std::vector<scored_docid_type> scored_data_type;
+    typedef wand_data<scorer_type>::block_enumerator block_enum_type;
+
+    block_max_ranked_and_query(wand_data<scorer_type> const& wdata,
+                               uint64_t k)
+        : m_wdata(&wdata), m_topk(k) {
+        assert(wdata.has_block_max());
+    }
+
+    template <typename Index>
+    uint64_t operator()(Index& index, term_id_vec terms) {
+        typedef typename Index::document_enumerator enum_type;
+
+        m_topk.clear();
+        if (terms.empty()) {
+            return 0;
+        }
+
+        auto query_term_freqs = query_freqs(terms);
+        std::vector<block_max_enum<enum_type>> enums;
+        enums.reserve(query_term_freqs.size());
+
+        uint64_t num_docs = index.num_docs();
+        for (auto term : query_term_freqs) {
+            auto list = index[term.first];
+            auto q_weight = scorer_type::query_term_weight(
+                term.second, list.size(), num_docs);
+            enums.push_back(block_max_enum<enum_type>{
+                std::move(list), m_wdata->block_max(term.first), q_weight});
+        }
+        // sort by increasing frequency
+        std::sort(enums.begin(), enums.end(),
+                  [](auto const& lhs, auto const& rhs) {
+                      return lhs.docs_enum.size() < rhs.docs_enum.size();
+                  });
+
+        // the docids from candidate to blocks_end are in the same blocks,
+        // and score at most blocks_bound
+        uint64_t candidate = enums[0].docs_enum.docid();
+        uint64_t blocks_end;
+        float blocks_bound;
+        move_blocks(enums, candidate, blocks_end, blocks_bound);
+        while (candidate < num_docs) {
+            if (candidate > blocks_end) {
+                move_blocks(enums, candidate, blocks_end, blocks_bound);
+            }
+
+            if (!m_topk.would_enter(blocks_bound)) {
+                if (blocks_end >= num_docs) break;
+                enums[0].docs_enum.next_geq(blocks_end + 1);
+                candidate = enums[0].docs_enum.docid();
+                continue;
+            }
+
+            size_t i = 0;
+            for (; i < enums.size(); ++i) {
+                enums[i].docs_enum.next_geq(candidate);
+                if (enums[i].docs_enum.docid() != candidate) {
+                    candidate = enums[i].docs_enum.docid();
+                    break;
+                }
+            }
+
+            if (i == enums.size()) {
+                float denominator = m_wdata->len_denominator(candidate);
+                float score = 0;
+                for (auto& e : enums) {
+                    score += e.q_weight *
+                             scorer_type::doc_term_weight_denominator(
+                                 e.docs_enum.freq(), denominator);
+                }
+
+                m_topk.insert(score, candidate);
+                enums[0].docs_enum.next();
+                candidate = enums[0].docs_enum.docid();
+            }
+        }
 
         m_topk.finalize();
         return m_topk.topk().size();
@@ -216,7 +411,109 @@ struct ranked_and_query {
     }
 
 private:
+    template <typename Enum>
+    struct block_max_enum {
+        Enum docs_enum;
+        block_enum_type blocks;
+        float q_weight;
+    };
+
+    template <typename Enum>
+    static void move_blocks(std::vector<block_max_enum<Enum>>& enums,
+                            uint64_t candidate, uint64_t& blocks_end,
+                            float& blocks_bound) {
+        blocks_end = uint64_t(-1);
+        blocks_bound = 0;
+        for (auto& e : enums) {
+            e.blocks.next_geq(candidate);
+            blocks_end = std::min(blocks_end, e.blocks.docid());
+            blocks_bound += e.q_weight * e.blocks.weight();
+        }
+    }
+
     wand_data<scorer_type> const* m_wdata;
     topk_queue<scored_data_type> m_topk;
 };
+
+// ranked_and_query over an index storing quantized impacts in place of the
+// frequencies (see impacts.hpp): the score of a document is the sum of its
+// impacts, each times the frequency of the term in the query, so no wand data
+// is needed and the scores are computed with integer additions
+struct impact_ranked_and_query {
+    typedef std::vector<scored_docid_type> scored_data_type;
+
+    impact_ranked_and_query(uint64_t k) : m_topk(k) {}
+
+    template <typename Index>
+    uint64_t operator()(Index& index, term_id_vec terms) {
+        typedef typename Index::document_enumerator enum_type;
+
+        m_topk.clear();
+        if (terms.empty()) {
+            return 0;
+        }
+
+        auto query_term_freqs = query_freqs(terms);
+        std::vector<impact_enum<enum_type>> enums;
+        enums.reserve(query_term_freqs.size());
+        for (auto term : query_term_freqs) {
+            enums.push_back(impact_enum<enum_type>{index[term.first],
+                                                   uint32_t(term.second)});
+        }
+        // sort by increasing frequency
+        std::sort(enums.begin(), enums.end(),
+                  [](auto const& lhs, auto const& rhs) {
+                      return lhs.docs_enum.size() < rhs.docs_enum.size();
+                  });
+
+        uint64_t num_docs = index.num_docs();
+        uint64_t candidate = enums[0].docs_enum.docid();
+        size_t i = 1;
+        while (candidate < num_docs) {
+#ifdef DS2I_PREFETCH_LISTS  // see and_query::intersect
+            for (size_t j = i + 1; j < enums.size(); ++j) {
+                enums[j].docs_enum.prefetch_geq(candidate);
+            }
+#endif
+            for (; i < enums.size(); ++i) {
+                enums[i].docs_enum.next_geq(candidate);
+                if (enums[i].docs_enum.docid() != candidate) {
+                    candidate = enums[i].docs_enum.docid();
+                    i = 0;
+                    break;
+                }
+            }
+
+            if (i == enums.size()) {
+                uint32_t score = 0;
+                for (i = 0; i < enums.size(); ++i) {
+                    score += enums[i].q_freq *
+                             uint32_t(enums[i].docs_enum.freq());
+                }
+
+                m_topk.insert(float(score), candidate);
+                enums[0].docs_enum.next();
+                candidate = enums[0].docs_enum.docid();
+                i = 1;
+            }
+        }
+
+        m_topk.finalize();
+        return m_topk.topk().size();
+    }
+
+    scored_data_type const& topk() const {
+        return m_topk.topk();
+    }
+
+private:
+    template <typename Enum>
+    struct impact_enum {
+        Enum docs_enum;
+        uint32_t q_freq;
+    };
+
+    topk_queue<scored_data_type> m_topk;
+};
+
 }  // namespace pvb
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "queries.hpp"
+
+namespace pvb {
+
+struct result_cache_statistics {
+    result_cache_statistics() : hits(0), misses(0), evictions(0) {}
+
+    double hit_ratio() const {
+        return hits + misses ? double(hits) / (hits + misses) : 0;
+    }
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// Cache of query results, keyed by the normalized query: its distinct terms,
+// sorted, with their query frequencies for ranked queries (see query_key).
+// The entries are split into shards by the hash of the key, each with its own
+// lock and least recently used eviction, so that concurrent queries rarely
+// wait for each other. At most max_entries results are kept.
+template <typename Value>
+class result_cache {
+public:
+    typedef result_cache_statistics statistics;
+
+    result_cache(uint64_t max_entries, size_t shards = 16)
+        : m_shards(std::max<uint64_t>(1, std::min<uint64_t>(shards,
+                                                             max_entries)))
+        , m_shard_entries(
+              std::max<uint64_t>(1, max_entries / m_shards.size())) {}
+
+    // the key of terms, with the query frequencies if with_freqs, as
+    // ranked_and_query counts them, and without as and_query
+    static term_freq_vec query_key(term_id_vec const& terms, bool with_freqs) {
+        term_freq_vec key = query_freqs(terms);
+        if (!with_freqs) {
+            for (auto& t : key) {
+                t.second = 1;
+            }
+        }
+        return key;
+    }
+
+    bool find(term_freq_vec const& key, Value& value) {
+        auto& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end()) {
+            s.stats.misses += 1;
+            return false;
+        }
+        s.stats.hits += 1;
+        s.entries.splice(s.entries.begin(), s.entries, it->second);
+        value = it->second->second;
+        return true;
+    }
+
+    void insert(term_freq_vec const& key, Value const& value) {
+        auto& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.map.count(key)) return;
+        s.entries.emplace_front(key, value);
+        s.map.emplace(key, s.entries.begin());
+        if (s.entries.size() > m_shard_entries) {
+            s.map.erase(s.entries.back().first);
+            s.entries.pop_back();
+            s.stats.evictions += 1;
+        }
+    }
+
+    statistics stats() const {
+        statistics stats;
+        for (auto const& s : m_shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            stats.hits += s.stats.hits;
+            stats.misses += s.stats.misses;
+            stats.evictions += s.stats.evictions;
+        }
+        return stats;
+    }
+
+private:
+    struct key_hash {
+        size_t operator()(term_freq_vec const& key) const {
+            uint64_t h = key.size();
+            for (auto const& t : key) {
+                h = (h ^ t.first) * 0x100000001b3ULL;
+                h = (h ^ t.second) * 0x100000001b3ULL;
+            }
+            return std::hash<uint64_t>()(h);
+        }
+    };
+
+    typedef std::list<std::pair<term_freq_vec, Value>> entry_list;
+
+    struct shard {
+        mutable std::mutex mutex;
+        entry_list entries;  // most recently used first
+        std::unordered_map<term_freq_vec, typename entry_list::iterator,
+                           key_hash>
+            map;
+        statistics stats;
+    };
+
+    shard& shard_of(term_freq_vec const& key) {
+        return m_shards[(key_hash()(key) >> 7) % m_shards.size()];
+    }
+
+    std::vector<shard> m_shards;
+    uint64_t m_shard_entries;
+};
+
+}  // namespace pvb
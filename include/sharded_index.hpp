@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "succinct/mappable_vector.hpp"
+#include "succinct/mapper.hpp"
+
+#include "configuration.hpp"
+#include "global_parameters.hpp"
+#include "term_directory.hpp"
+#include "util.hpp"
+
+namespace pvb {
+
+// Index split by docid ranges into shards, each a complete Index holding the
+// postings of its range. The shards keep the global docids (their universe is
+// the total number of documents), so that their enumerators can be used
+// as-is by the queries and the scorer. A term missing from a shard has no
+// list there; the lists of each shard are addressed through a map from the
+// global term ids.
+//
+// operator[] returns an enumerator over the concatenation of the shard lists,
+// so any algorithm working on Index also works on the sharded index. In
+// addition, parallel_shards() runs a function on all the shards at once, to
+// scatter a query and then gather its results (see queries.hpp).
+//
+// The number of shards is given by DS2I_SHARDS, by default the number of
+// worker threads, and the shards are built in parallel.
+template <typename Index>
+class sharded_index {
+public:
+    typedef typename Index::document_enumerator shard_enumerator;
+    static const uint32_t absent = uint32_t(-1);
+
+private:
+    struct index_shard {
+        Index index;
+        succinct::mapper::mappable_vector<uint32_t> lists;
+
+        template <typename Visitor>
+        void map(Visitor& visit) {
+            visit(index, "index")(lists, "lists");
+        }
+    };
+
+public:
+    class builder {
+    public:
+        builder(uint64_t num_docs, global_parameters const& params)
+            : m_params(params)
+            , m_num_docs(num_docs)
+            , m_num_terms(0)
+            , m_conf(nullptr) {}
+
+        // the iterators must stay valid until build() is called: the lists
+        // are only split here, and compressed by the shard builders later
+        template <typename DocsIterator, typename FreqsIterator>
+        void add_posting_list(uint64_t n, DocsIterator docs_begin,
+                              FreqsIterator freqs_begin,
+                              uint64_t /* occurrences */,
+                              configuration const& conf) {
+            static_assert(
+                std::is_convertible<DocsIterator, uint32_t const*>::value and
+                    std::is_convertible<FreqsIterator, uint32_t const*>::value,
+                "sharded_index needs the lists in memory");
+            if (!n) throw std::invalid_argument("List must be nonempty");
+
+            if (m_shard_begins.empty()) {
+                m_conf = &conf;
+                uint64_t shards = std::max<uint64_t>(
+                    1, std::min<uint64_t>(conf.num_shards, m_num_docs));
+                for (uint64_t s = 0; s <= shards; ++s) {
+                    m_shard_begins.push_back(m_num_docs * s / shards);
+                }
+                m_slices.resize(shards);
+            }
+
+            uint32_t const* docs = docs_begin;
+            uint32_t const* freqs = freqs_begin;
+            uint32_t const* docs_end = docs + n;
+            for (size_t s = 0; s < m_slices.size(); ++s) {
+                auto begin = std::lower_bound(docs, docs_end,
+                                              uint32_t(m_shard_begins[s]));
+                auto end = std::lower_bound(begin, docs_end,
+                                            uint32_t(m_shard_begins[s + 1]));
+                if (begin != end) {
+                    m_slices[s].push_back(slice{m_num_terms, begin,
+                                                freqs + (begin - docs),
+                                                uint64_t(end - begin)});
+                }
+            }
+            ++m_num_terms;
+        }
+
+        void build(sharded_index& sq) {
+            sq.m_params = m_params;
+            sq.m_num_docs = m_num_docs;
+            sq.m_size = m_num_terms;
+            sq.m_shards.resize(m_slices.size());
+            std::vector<uint64_t> shard_begins(m_shard_begins);
+            sq.m_shard_begins.steal(shard_begins);
+
+            std::vector<std::thread> workers;
+            for (size_t s = 0; s < m_slices.size(); ++s) {
+                workers.emplace_back(
+                    [&, s] { build_shard(s, sq.m_shards[s]); });
+            }
+            for (auto& w : workers) {
+                w.join();
+            }
+
+            std::vector<uint64_t> list_sizes(m_num_terms, 0);
+            for (auto const& slices : m_slices) {
+                for (auto const& sl : slices) {
+                    list_sizes[sl.term] += sl.n;
+                }
+            }
+            sq.m_list_sizes.steal(list_sizes);
+        }
+
+    private:
+        struct slice {
+            uint64_t term;
+            uint32_t const* docs;
+            uint32_t const* freqs;
+            uint64_t n;
+        };
+
+        void build_shard(size_t s, index_shard& sh) {
+            typename Index::builder builder(m_num_docs, m_params);
+            std::vector<uint32_t> lists(m_num_terms, absent);
+            uint32_t local_id = 0;
+            for (auto const& sl : m_slices[s]) {
+                uint64_t occurrences =
+                    std::accumulate(sl.freqs, sl.freqs + sl.n, uint64_t(0));
+                builder.add_posting_list(sl.n, sl.docs, sl.freqs, occurrences,
+                                         *m_conf);
+                lists[sl.term] = local_id++;
+            }
+            if (local_id) {
+                builder.build(sh.index);
+            }
+            sh.lists.steal(lists);
+        }
+
+        global_parameters m_params;
+        uint64_t m_num_docs;
+        uint64_t m_num_terms;
+        configuration const* m_conf;
+        std::vector<uint64_t> m_shard_begins;
+        std::vector<std::vector<slice>> m_slices;
+    };
+
+    class document_enumerator {
+    public:
+        void reset() {
+            m_cur = 0;
+            m_lists[0].reset();
+        }
+
+        void DS2I_FLATTEN_FUNC next() {
+            m_lists[m_cur].next();
+            if (DS2I_UNLIKELY(m_lists[m_cur].docid() == m_num_docs)) {
+                next_shard();
+            }
+        }
+
+        void DS2I_FLATTEN_FUNC next_geq(uint64_t lower_bound) {
+            if (DS2I_UNLIKELY(lower_bound >= m_ends[m_cur])) {
+                size_t cur = m_cur;
+                while (m_cur + 1 < m_lists.size() and
+                       lower_bound >= m_ends[m_cur]) {
+                    ++m_cur;
+                }
+                if (m_cur != cur) {
+                    m_lists[m_cur].reset();
+                }
+            }
+            m_lists[m_cur].next_geq(lower_bound);
+            if (DS2I_UNLIKELY(m_lists[m_cur].docid() == m_num_docs)) {
+                next_shard();
+            }
+        }
+
+        void prefetch_geq(uint64_t lower_bound) const {
+            if (lower_bound < m_ends[m_cur]) {
+                m_lists[m_cur].prefetch_geq(lower_bound);
+            }
+        }
+
+        void move(uint64_t position) {
+            m_cur = std::upper_bound(m_bases.begin(), m_bases.end(),
+                                     position) -
+                    m_bases.begin() - 1;
+            m_lists[m_cur].move(position - m_bases[m_cur]);
+        }
+
+        uint64_t docid() const {
+            return m_lists[m_cur].docid();
+        }
+
+        uint64_t DS2I_FLATTEN_FUNC freq() {
+            return m_lists[m_cur].freq();
+        }
+
+        uint64_t position() const {
+            return m_bases[m_cur] + m_lists[m_cur].position();
+        }
+
+        uint64_t size() const {
+            return m_size;
+        }
+
+        uint64_t num_partitions() const {
+            uint64_t partitions = 0;
+            for (auto const& list : m_lists) {
+                partitions += list.num_partitions();
+            }
+            return partitions;
+        }
+
+    private:
+        friend class sharded_index;
+
+        document_enumerator(uint64_t num_docs) : m_num_docs(num_docs) {}
+
+        void add(shard_enumerator const& list, uint64_t shard_end) {
+            m_bases.push_back(m_lists.empty() ? 0
+                                              : m_bases.back() +
+                                                    m_lists.back().size());
+            m_lists.push_back(list);
+            m_ends.push_back(shard_end);
+        }
+
+        void next_shard() {
+            if (m_cur + 1 < m_lists.size()) {
+                ++m_cur;
+                m_lists[m_cur].reset();
+            }
+        }
+
+        uint64_t m_num_docs;
+        uint64_t m_size;
+        size_t m_cur;
+        std::vector<shard_enumerator> m_lists;
+        std::vector<uint64_t> m_ends;   // end of the docid range of each list
+        std::vector<uint64_t> m_bases;  // position of the first posting
+    };
+
+    sharded_index() : m_num_docs(0), m_size(0) {}
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    uint64_t num_docs() const {
+        return m_num_docs;
+    }
+
+    size_t num_shards() const {
+        return m_shards.size();
+    }
+
+    Index& shard(size_t s) {
+        return m_shards[s].index;
+    }
+
+    // id of the list of term in shard s, or absent
+    uint32_t shard_list(size_t s, size_t term) const {
+        return m_shards[s].lists[term];
+    }
+
+    // number of postings of term across all shards
+    uint64_t list_size(size_t term) const {
+        return m_list_sizes[term];
+    }
+
+    document_enumerator operator[](size_t i) {
+        assert(i < size());
+        document_enumerator e(m_num_docs);
+        for (size_t s = 0; s < num_shards(); ++s) {
+            uint32_t list = m_shards[s].lists[i];
+            if (list != absent) {
+                e.add(m_shards[s].index[list], m_shard_begins[s + 1]);
+            }
+        }
+        e.m_size = m_list_sizes[i];
+        e.reset();
+        return e;
+    }
+
+    // calls f(s) for each shard s, in parallel
+    template <typename Function>
+    void parallel_shards(Function f) {
+        if (num_shards() == 1) {
+            f(0);
+            return;
+        }
+        if (!m_executor) {
+            m_executor.reset(new executor_type(num_shards() - 1));
+        }
+        task_region(*m_executor, [&](task_region_handle& trh) {
+            for (size_t s = 1; s < num_shards(); ++s) {
+                trh.run([&, s] { f(s); });
+            }
+            f(0);
+        });
+    }
+
+    void warmup(size_t i) const {
+        assert(i < size());
+        for (auto const& sh : m_shards) {
+            if (sh.lists[i] != absent) {
+                sh.index.warmup(sh.lists[i]);
+            }
+        }
+    }
+
+    void build_term_directory() {
+        for (auto& sh : m_shards) {
+            if (sh.index.size()) {
+                sh.index.build_term_directory();
+            }
+        }
+    }
+
+    uint64_t term_directory_size() const {
+        uint64_t bytes = 0;
+        for (auto const& sh : m_shards) {
+            bytes += sh.index.term_directory_size();
+        }
+        return bytes;
+    }
+
+    global_parameters& params() {
+        return m_params;
+    }
+
+    void swap(sharded_index& other) {
+        std::swap(m_params, other.m_params);
+        std::swap(m_num_docs, other.m_num_docs);
+        std::swap(m_size, other.m_size);
+        m_shard_begins.swap(other.m_shard_begins);
+        m_list_sizes.swap(other.m_list_sizes);
+        m_shards.swap(other.m_shards);
+        m_executor.swap(other.m_executor);
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit) {
+        visit(m_params, "m_params")(m_num_docs, "m_num_docs")(m_size, "m_size")(
+            m_shard_begins, "m_shard_begins")(m_list_sizes, "m_list_sizes");
+        // when mapping, the number of shards is known only at this point
+        m_shards.resize(m_shard_begins.size() ? m_shard_begins.size() - 1 : 0);
+        for (auto& sh : m_shards) {
+            visit(sh, "m_shards");
+        }
+    }
+
+private:
+    global_parameters m_params;
+    uint64_t m_num_docs;
+    uint64_t m_size;
+    succinct::mapper::mappable_vector<uint64_t> m_shard_begins;
+    succinct::mapper::mappable_vector<uint64_t> m_list_sizes;
+    std::vector<index_shard> m_shards;
+    std::unique_ptr<executor_type> m_executor;
+};
+
+template <typename Index>
+const uint32_t sharded_index<Index>::absent;
+
+// The term directories of the shards are written after the sharded index, one
+// per shard in order (empty for the shards without lists), when they were
+// built (see term_directory)
+template <typename Index>
+auto save_index(sharded_index<Index>& index, const char* filename)
+    -> decltype(index.shard(0).directory(), void()) {
+    std::ofstream fout(filename, std::ios::binary);
+    uint64_t bytes = succinct::mapper::freeze(index, fout);
+    bool built = false;
+    for (size_t s = 0; s < index.num_shards(); ++s) {
+        built = built or !index.shard(s).directory().empty();
+    }
+    if (!built) return;
+    for (size_t s = 0; s < index.num_shards(); ++s) {
+        auto& directory = index.shard(s).directory();
+        if (!directory.empty()) {
+            directory.align(bytes);
+        }
+        bytes += succinct::mapper::freeze(directory, fout);
+    }
+}
+
+template <typename Index>
+auto map_index(sharded_index<Index>& index, const char* data, uint64_t size)
+    -> decltype(index.shard(0).directory(), void()) {
+    uint64_t bytes = succinct::mapper::map(index, data);
+    if (bytes < size) {
+        for (size_t s = 0; s < index.num_shards(); ++s) {
+            bytes += succinct::mapper::map(index.shard(s).directory(),
+                                           data + bytes);
+        }
+    }
+}
+
+}  // namespace pvb
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "succinct/mappable_vector.hpp"
+#include "succinct/mapper.hpp"
+
+namespace pvb {
+
+// Optional table with a fixed-width entry per list, holding what is needed to
+// open it (offsets, df, occurrences), so that list opens in short-query
+// workloads read a single entry instead of moving the Elias-Fano endpoints
+// and decoding the variable-length headers. Entries are padded to a power of
+// two dividing the cache line size, and the table is aligned to a cache line
+// of the mapped file (see align), so that each entry lies in a single line.
+//
+// The directory is not part of the map() of the indexes: save_index writes
+// it after the index, only when it was built, so that the files of the
+// indexes built without it keep their layout, and map_index maps it when the
+// file has one.
+template <typename Entry>
+class term_directory {
+public:
+    static_assert(sizeof(Entry) == 16 or sizeof(Entry) == 32 or
+                      sizeof(Entry) == 64,
+                  "term_directory entries must divide a cache line");
+
+    static const uint64_t line_size = 64;
+
+    term_directory() : m_pad(0) {}
+
+    void build(std::vector<Entry> const& entries) {
+        std::vector<uint8_t> bytes(entries.size() * sizeof(Entry));
+        std::memcpy(bytes.data(), entries.data(), bytes.size());
+        m_pad = 0;
+        m_bytes.steal(bytes);
+    }
+
+    // Pads the table so that the entries start on a cache line once the
+    // directory is written at the given byte offset of a file mapped at a
+    // page boundary; the pad is stored as a number of leading bytes
+    void align(uint64_t offset) {
+        // the entries follow m_pad and the size of m_bytes
+        uint64_t entries_offset = offset + 2 * sizeof(uint64_t);
+        uint64_t pad = (line_size - entries_offset % line_size) % line_size;
+        std::vector<uint8_t> bytes(pad + size() * sizeof(Entry), 0);
+        std::copy(m_bytes.begin() + m_pad, m_bytes.end(), bytes.begin() + pad);
+        m_pad = pad;
+        m_bytes.steal(bytes);
+    }
+
+    bool empty() const {
+        return m_bytes.size() == 0;
+    }
+
+    size_t size() const {
+        return empty() ? 0 : (m_bytes.size() - m_pad) / sizeof(Entry);
+    }
+
+    Entry const& operator[](size_t i) const {
+        assert(i < size());
+        return reinterpret_cast<Entry const*>(m_bytes.data() + m_pad)[i];
+    }
+
+    void swap(term_directory& other) {
+        std::swap(m_pad, other.m_pad);
+        m_bytes.swap(other.m_bytes);
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit) {
+        visit(m_pad, "m_pad")(m_bytes, "m_bytes");
+    }
+
+private:
+    uint64_t m_pad;
+    succinct::mapper::mappable_vector<uint8_t> m_bytes;
+};
+
+// Writes index to filename, followed by its term directory if it was built
+template <typename Index>
+auto save_index(Index& index, const char* filename)
+    -> decltype(index.directory(), void()) {
+    std::ofstream fout(filename, std::ios::binary);
+    uint64_t bytes = succinct::mapper::freeze(index, fout);
+    auto& directory = index.directory();
+    if (!directory.empty()) {
+        directory.align(bytes);
+        succinct::mapper::freeze(directory, fout);
+    }
+}
+
+template <typename Index, typename... Unused>
+void save_index(Index& index, const char* filename, Unused...) {
+    succinct::mapper::freeze(index, filename);
+}
+
+// Maps an index written by save_index from the size bytes at data, with its
+// term directory if the file has one
+template <typename Index>
+auto map_index(Index& index, const char* data, uint64_t size)
+    -> decltype(index.directory(), void()) {
+    uint64_t bytes = succinct::mapper::map(index, data);
+    if (bytes < size) {
+        succinct::mapper::map(index.directory(), data + bytes);
+    }
+}
+
+template <typename Index, typename... Unused>
+void map_index(Index& index, const char* data, uint64_t, Unused...) {
+    succinct::mapper::map(index, data);
+}
+
+}  // namespace pvb
@@ -8,9 +8,11 @@
 #include "block_codecs.hpp"
 #include "block_freq_index.hpp"
 #include "freq_index.hpp"
+#include "sharded_index.hpp"
 
 #include "partitioned_sequence.hpp"
 #include "partitioned_vb_sequence.hpp"
+#include "partitioned_freqs_sequence.hpp"
 
 #include "positive_sequence.hpp"
 #include "indexed_sequence.hpp"
@@ -25,12 +27,12 @@ namespace pvb {
 /* Partitioned VByte indexes */
 
 typedef uniform_partitioned_sequence<
-    indexed_sequence<block_sequence<maskedvbyte_block>>,
+    indexed_sequence<block_sequence<maskedvbyte_block<>>>,
     // uncompressed_upper_bounds
     compact_elias_fano>
     uniform2_vb_sequence;
 
-typedef uniform_partitioned_sequence<block_sequence<maskedvbyte_block>,
+typedef uniform_partitioned_sequence<block_sequence<maskedvbyte_block<>>,
                                      // uncompressed_upper_bounds
                                      compact_elias_fano>
     uniform1_vb_sequence;
@@ -39,25 +41,56 @@ using uniform_vb_index =
     freq_index<uniform2_vb_sequence, positive_sequence<uniform2_vb_sequence>>;
 
 // solution with dynamic programming
-using opt_vb_dp_index = freq_index<
-    partitioned_sequence<block_sequence<maskedvbyte_block>>,
-    positive_sequence<partitioned_sequence<block_sequence<maskedvbyte_block>>>>;
+using opt_vb_dp_index =
+    freq_index<partitioned_sequence<block_sequence<maskedvbyte_block<>>>,
+               positive_sequence<
+                   partitioned_sequence<block_sequence<maskedvbyte_block<>>>>>;
 
 // solution with scan
-using opt_vb_index =
-    freq_index<partitioned_vb_sequence<maskedvbyte_block>,
-               positive_sequence<partitioned_vb_sequence<maskedvbyte_block>>>;
+template <uint64_t BlockSize>
+using opt_vb_sized_index = freq_index<
+    partitioned_vb_sequence<maskedvbyte_block<BlockSize>>,
+    positive_sequence<partitioned_vb_sequence<maskedvbyte_block<BlockSize>>>>;
+
+using opt_vb_index = opt_vb_sized_index<constants::block_size>;
+using opt_vb_64_index = opt_vb_sized_index<64>;
+using opt_vb_256_index = opt_vb_sized_index<256>;
+
+// docs and freqs of each list stored next to each other
+using opt_vb_interleaved_index =
+    freq_index<partitioned_vb_sequence<maskedvbyte_block<>>,
+               positive_sequence<partitioned_vb_sequence<maskedvbyte_block<>>>,
+               true>;
+
+// same docs, frequencies with implicit runs of ones
+using opt_vb_runs_index =
+    freq_index<partitioned_vb_sequence<maskedvbyte_block<>>,
+               partitioned_freqs_sequence>;
+
+// opt_vb shards over docid ranges, queried in parallel
+using sharded_opt_vb_index = sharded_index<opt_vb_index>;
 
 /* Unpartitioned VByte indexes */
-using block_streamvbyte_index = block_freq_index<streamvbyte_block>;
-using block_maskedvbyte_index = block_freq_index<maskedvbyte_block>;
-using block_varintg8iu_index = block_freq_index<varintg8iu_block>;
-using block_varintgb_index = block_freq_index<varintgb_block>;
+using block_streamvbyte_index = block_freq_index<streamvbyte_block<>>;
+using block_maskedvbyte_index = block_freq_index<maskedvbyte_block<>>;
+using block_varintg8iu_index = block_freq_index<varintg8iu_block<>>;
+using block_varintgb_index = block_freq_index<varintgb_block<>>;
+
+// the same with smaller and larger blocks than constants::block_size
+using block_streamvbyte_64_index = block_freq_index<streamvbyte_block<64>>;
+using block_maskedvbyte_64_index = block_freq_index<maskedvbyte_block<64>>;
+using block_varintg8iu_64_index = block_freq_index<varintg8iu_block<64>>;
+using block_varintgb_64_index = block_freq_index<varintgb_block<64>>;
+
+using block_streamvbyte_256_index = block_freq_index<streamvbyte_block<256>>;
+using block_maskedvbyte_256_index = block_freq_index<maskedvbyte_block<256>>;
+using block_varintg8iu_256_index = block_freq_index<varintg8iu_block<256>>;
+using block_varintgb_256_index = block_freq_index<varintgb_block<256>>;
 
 /* Benchmark and test sequences */
-using vb_sequence = block_posting_list<maskedvbyte_block>;
+using vb_sequence = block_posting_list<maskedvbyte_block<>>;
 
-using bic_sequence = block_posting_list<interpolative_block>;
+using bic_sequence = block_posting_list<interpolative_block<>>;
 
 using uniform_ef_sequence =
     uniform_partitioned_sequence<compact_elias_fano, compact_elias_fano
@@ -70,9 +103,29 @@ using uniform_rb_sequence =
                                  >;
 }  // namespace pvb
 
-#define DS2I_INDEX_TYPES                                                      \
+// The variants with blocks of 64 and 256 postings are only dispatched by
+// create_freq_index and scan_perftest, unless the tree is built with
+// -DOPT_VB_BLOCK_SIZE_TYPES=ON, as each type instantiates all the code of the
+// tools that dispatch it
+#define DS2I_BLOCK_SIZE_INDEX_TYPES                                        \
+    (block_varintg8iu_64)(block_streamvbyte_64)(block_maskedvbyte_64)(     \
+        block_varintgb_64)(opt_vb_64)(block_varintg8iu_256)(               \
+        block_streamvbyte_256)(block_maskedvbyte_256)(block_varintgb_256)( \
+        opt_vb_256)
+
+#define DS2I_DEFAULT_INDEX_TYPES                                              \
     (block_varintg8iu)(block_streamvbyte)(block_maskedvbyte)(block_varintgb)( \
-        uniform_vb)(opt_vb_dp)(opt_vb)
+        uniform_vb)(opt_vb_dp)(opt_vb)(opt_vb_runs)(opt_vb_interleaved)(      \
+        sharded_opt_vb)
+
+#define DS2I_ALL_INDEX_TYPES \
+    DS2I_DEFAULT_INDEX_TYPES DS2I_BLOCK_SIZE_INDEX_TYPES
+
+#ifdef DS2I_BLOCK_SIZE_TYPES
+#define DS2I_INDEX_TYPES DS2I_ALL_INDEX_TYPES
+#else
+#define DS2I_INDEX_TYPES DS2I_DEFAULT_INDEX_TYPES
+#endif
 
 #define DS2I_BLOCK_INDEX_TYPES \
     (block_streamvbyte)(block_maskedvbyte)(block_varintg8iu)(block_varintgb)
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "succinct/bit_vector.hpp"
+#include "succinct/broadword.hpp"
+
+#include "cpu_features.hpp"
+#include "util.hpp"
+
+namespace pvb {
+
+namespace bmi2 {
+
+// deposit a single bit at the k-th one of x and take its position
+__attribute__((target("bmi,bmi2"))) inline uint64_t select_in_word(
+    uint64_t x, uint64_t k) {
+    assert(k < succinct::broadword::popcount(x));
+    return _tzcnt_u64(_pdep_u64(uint64_t(1) << k, x));
+}
+
+}  // namespace bmi2
+
+inline uint64_t select_in_word(uint64_t x, uint64_t k) {
+    static const bool has_bmi2 = cpu_features::get().bmi2;
+    if (has_bmi2) {
+        return bmi2::select_in_word(x, k);
+    }
+    return succinct::broadword::select_in_word(x, k);
+}
+
+// Same interface as succinct::bit_vector::unary_enumerator, but skip() and
+// skip0() select inside the last word with pdep/tzcnt when BMI2 is available.
+class unary_enumerator {
+public:
+    unary_enumerator() : m_data(0), m_position(0), m_buf(0) {}
+
+    unary_enumerator(succinct::bit_vector const& bv, uint64_t pos) {
+        m_data = bv.data().data();
+        m_position = pos;
+        m_buf = m_data[pos / 64];
+        // clear low bits
+        m_buf &= uint64_t(-1) << (pos % 64);
+    }
+
+    uint64_t position() const {
+        return m_position;
+    }
+
+    uint64_t next() {
+        unsigned long pos_in_word;
+        uint64_t buf = m_buf;
+        while (!succinct::broadword::lsb(buf, pos_in_word)) {
+            m_position += 64;
+            buf = m_data[m_position / 64];
+        }
+
+        m_buf = buf & (buf - 1);  // clear LSB
+        m_position = (m_position & ~uint64_t(63)) + pos_in_word;
+        return m_position;
+    }
+
+    // skip to the k-th one after the current position
+    void skip(uint64_t k) {
+        uint64_t skipped = 0;
+        uint64_t buf = m_buf;
+        uint64_t w = 0;
+        while (skipped + (w = succinct::broadword::popcount(buf)) <= k) {
+            skipped += w;
+            m_position += 64;
+            buf = m_data[m_position / 64];
+        }
+        assert(buf);
+        uint64_t pos_in_word = select_in_word(buf, k - skipped);
+        m_buf = buf & (uint64_t(-1) << pos_in_word);
+        m_position = (m_position & ~uint64_t(63)) + pos_in_word;
+    }
+
+    // skip to the k-th zero after the current position
+    void skip0(uint64_t k) {
+        uint64_t skipped = 0;
+        uint64_t pos_in_word = m_position % 64;
+        uint64_t buf = ~m_buf & (uint64_t(-1) << pos_in_word);
+        uint64_t w = 0;
+        while (skipped + (w = succinct::broadword::popcount(buf)) <= k) {
+            skipped += w;
+            m_position += 64;
+            buf = ~m_data[m_position / 64];
+        }
+        assert(buf);
+        pos_in_word = select_in_word(buf, k - skipped);
+        m_buf = ~buf & (uint64_t(-1) << pos_in_word);
+        m_position = (m_position & ~uint64_t(63)) + pos_in_word;
+    }
+
+private:
+    uint64_t const* m_data;
+    uint64_t m_position;
+    uint64_t m_buf;
+};
+
+}  // namespace pvb
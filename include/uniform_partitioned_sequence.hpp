@@ -3,6 +3,7 @@
 #include <stdexcept>
 
 #include "compact_elias_fano.hpp"
+#include "compact_ranked_bitvector.hpp"
 #include "global_parameters.hpp"
 #include "configuration.hpp"
 #include "integer_codes.hpp"
@@ -96,6 +96,19 @@ struct uniform_partitioned_sequence_enumerator {
         return slow_next_geq(lower_bound);
     }
 
+    // prefetches the data of the next partition if next_geq(lower_bound)
+    // leaves the current one, as in partitioned_sequence_enumerator
+    void DS2I_ALWAYSINLINE prefetch_geq(uint64_t lower_bound) const {
+        if (DS2I_LIKELY(lower_bound <= m_cur_upper_bound)) return;
+        uint64_t partition = m_cur_partition + 1;
+        if (partition >= m_partitions) return;
+
+        uint64_t endpoint = m_bv->get_bits(
+            m_endpoints_offset + (partition - 1) * m_endpoint_bits,
+            m_endpoint_bits);
+        m_bv->data().prefetch((m_sequences_offset + endpoint) / 64);
+    }
+
     pv_type DS2I_ALWAYSINLINE next() {
         ++m_position;
         if (DS2I_LIKELY(m_position < m_cur_end)) {
@@ -117,6 +130,29 @@ struct uniform_partitioned_sequence_enumerator {
         return m_size;
     }
 
+    uint64_t num_partitions() const {
+        return m_partitions;
+    }
+
+    // the docids of the current partition are in [partition_base(),
+    // partition_upper_bound()], and the positions before partition_end()
+    uint64_t partition_base() const {
+        return m_cur_base;
+    }
+
+    uint64_t partition_upper_bound() const {
+        return m_cur_upper_bound;
+    }
+
+    uint64_t partition_end() const {
+        return m_cur_end;
+    }
+
+    // the current partition, if it is stored as a bitmap, or nullptr
+    compact_ranked_bitvector::enumerator const* partition_bitmap() const {
+        return m_partition_enumerator.bitmap();
+    }
+
     uint64_t docid() const {
         return m_value;
     }
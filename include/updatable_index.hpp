@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "configuration.hpp"
+#include "global_parameters.hpp"
+#include "util.hpp"
+
+namespace pvb {
+
+// Index accepting new documents, organized as a stack of immutable segments
+// as in a log-structured merge tree. Each segment is an ordinary Index over a
+// contiguous range of docids, stored with local docids starting from zero.
+//
+// add_document() appends to an in-memory buffer; every segment_docs documents
+// (or on flush()) the buffer is compressed into a new segment, and only then
+// are its documents visible to the queries. Whenever merge_factor adjacent
+// segments of the same level exist, a background thread merges them into a
+// single segment of the next level, so that the number of segments stays
+// logarithmic in the number of documents.
+//
+// Queries run on a snapshot(), that shares the segments existing at the time
+// it is taken: merges replace segments in the stack, but never modify them.
+// The snapshot has the interface of an index, with the lists of the segments
+// concatenated and their docids shifted by the segment offsets.
+template <typename Index>
+class updatable_index {
+public:
+    typedef typename Index::document_enumerator segment_enumerator;
+    static const uint32_t absent = uint32_t(-1);
+
+    struct parameters {
+        parameters()
+            : segment_docs(10000), merge_factor(4), merge_threads(1) {}
+
+        uint64_t segment_docs;
+        uint64_t merge_factor;
+        uint64_t merge_threads;
+    };
+
+    struct statistics {
+        uint64_t flushes;
+        uint64_t merges;
+        uint64_t merged_postings;
+        double merge_time;  // seconds, summed over the merge threads
+    };
+
+private:
+    struct segment {
+        uint64_t base;
+        uint64_t num_docs;
+        uint64_t postings;
+        uint64_t level;
+        bool merging;
+        Index index;
+        std::vector<uint32_t> lists;  // list of each term, or absent
+
+        uint32_t list(size_t term) const {
+            return term < lists.size() ? lists[term] : absent;
+        }
+    };
+
+    typedef std::shared_ptr<segment> segment_ptr;
+
+public:
+    class snapshot {
+    public:
+        class document_enumerator {
+        public:
+            void reset() {
+                m_cur = 0;
+                if (!m_lists.empty()) m_lists[0].reset();
+                update();
+            }
+
+            void DS2I_FLATTEN_FUNC next() {
+                m_lists[m_cur].next();
+                update();
+            }
+
+            void DS2I_FLATTEN_FUNC next_geq(uint64_t lower_bound) {
+                if (lower_bound > m_docid) {
+                    size_t cur = m_cur;
+                    while (m_cur + 1 < m_lists.size() and
+                           lower_bound >= m_ends[m_cur]) {
+                        ++m_cur;
+                    }
+                    if (m_cur != cur) {
+                        m_lists[m_cur].reset();
+                    }
+                    if (lower_bound > m_bases[m_cur]) {
+                        m_lists[m_cur].next_geq(lower_bound - m_bases[m_cur]);
+                    }
+                    update();
+                }
+            }
+
+            // only within the current segment
+            void prefetch_geq(uint64_t lower_bound) const {
+                if (lower_bound > m_bases[m_cur] and
+                    lower_bound < m_ends[m_cur]) {
+                    m_lists[m_cur].prefetch_geq(lower_bound - m_bases[m_cur]);
+                }
+            }
+
+            uint64_t docid() const {
+                return m_docid;
+            }
+
+            uint64_t DS2I_FLATTEN_FUNC freq() {
+                return m_lists[m_cur].freq();
+            }
+
+            uint64_t size() const {
+                return m_size;
+            }
+
+            uint64_t num_partitions() const {
+                uint64_t partitions = 0;
+                for (auto const& list : m_lists) {
+                    partitions += list.num_partitions();
+                }
+                return partitions;
+            }
+
+        private:
+            friend class snapshot;
+
+            document_enumerator(uint64_t num_docs)
+                : m_num_docs(num_docs), m_size(0), m_cur(0) {}
+
+            // moves to the next segment when the current list is over, and
+            // converts the docid to the global space
+            void update() {
+                while (true) {
+                    if (m_lists.empty()) {
+                        m_docid = m_num_docs;
+                        return;
+                    }
+                    uint64_t local = m_lists[m_cur].docid();
+                    if (DS2I_LIKELY(local + m_bases[m_cur] < m_ends[m_cur])) {
+                        m_docid = m_bases[m_cur] + local;
+                        return;
+                    }
+                    if (m_cur + 1 == m_lists.size()) {
+                        m_docid = m_num_docs;
+                        return;
+                    }
+                    ++m_cur;
+                    m_lists[m_cur].reset();
+                }
+            }
+
+            uint64_t m_num_docs;
+            uint64_t m_size;
+            uint64_t m_docid;
+            size_t m_cur;
+            std::vector<segment_enumerator> m_lists;
+            std::vector<uint64_t> m_bases;
+            std::vector<uint64_t> m_ends;
+        };
+
+        uint64_t num_docs() const {
+            return m_num_docs;
+        }
+
+        uint64_t size() const {
+            return m_num_terms;
+        }
+
+        size_t num_segments() const {
+            return m_segments.size();
+        }
+
+        document_enumerator operator[](size_t term) const {
+            document_enumerator e(m_num_docs);
+            for (auto const& seg : m_segments) {
+                uint32_t list = seg->list(term);
+                if (list != absent) {
+                    e.m_lists.push_back(seg->index[list]);
+                    e.m_bases.push_back(seg->base);
+                    e.m_ends.push_back(seg->base + seg->num_docs);
+                    e.m_size += e.m_lists.back().size();
+                }
+            }
+            e.reset();
+            return e;
+        }
+
+    private:
+        friend class updatable_index;
+
+        std::vector<segment_ptr> m_segments;
+        uint64_t m_num_docs;
+        uint64_t m_num_terms;
+    };
+
+    updatable_index(configuration const& conf,
+                    parameters const& params = parameters())
+        : m_conf(conf)
+        , m_params(params)
+        , m_num_docs(0)
+        , m_buffer_docs(0)
+        , m_running_merges(0)
+        , m_stop(false)
+        , m_stats() {
+        m_params.segment_docs = std::max<uint64_t>(1, m_params.segment_docs);
+        m_params.merge_factor = std::max<uint64_t>(2, m_params.merge_factor);
+        for (uint64_t t = 0; t < m_params.merge_threads; ++t) {
+            m_mergers.emplace_back([this] { merge_loop(); });
+        }
+    }
+
+    ~updatable_index() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (auto& t : m_mergers) {
+            t.join();
+        }
+    }
+
+    // adds a document made of (term, freq) pairs, with distinct terms, and
+    // returns its docid
+    template <typename TermFreqs>
+    uint64_t add_document(TermFreqs const& terms) {
+        uint64_t local = m_buffer_docs++;
+        for (auto const& tf : terms) {
+            if (tf.first >= m_buffer_docids.size()) {
+                m_buffer_docids.resize(tf.first + 1);
+                m_buffer_freqs.resize(tf.first + 1);
+            }
+            m_buffer_docids[tf.first].push_back(local);
+            m_buffer_freqs[tf.first].push_back(tf.second);
+        }
+        uint64_t docid = m_num_docs + local;
+        if (m_buffer_docs == m_params.segment_docs) {
+            flush();
+        }
+        return docid;
+    }
+
+    // compresses the buffered documents into a segment, making them visible
+    void flush() {
+        if (!m_buffer_docs) return;
+        auto seg = std::make_shared<segment>();
+        seg->base = m_num_docs;
+        seg->num_docs = m_buffer_docs;
+        seg->level = 0;
+        seg->merging = false;
+        build_segment(*seg, m_buffer_docids.size(), [&](size_t term, auto f) {
+            if (!m_buffer_docids[term].empty()) {
+                f(m_buffer_docids[term], m_buffer_freqs[term]);
+            }
+        });
+
+        m_num_docs += m_buffer_docs;
+        m_buffer_docs = 0;
+        m_buffer_docids.clear();
+        m_buffer_freqs.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_segments.push_back(seg);
+            m_stats.flushes += 1;
+        }
+        m_cond.notify_all();
+    }
+
+    // blocks until no merge is running or could be started
+    void wait_merges() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle_cond.wait(lock, [&] {
+            return !m_running_merges and !find_merge().second;
+        });
+    }
+
+    snapshot get_snapshot() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        snapshot s;
+        s.m_segments = m_segments;
+        s.m_num_docs = m_segments.empty()
+                           ? 0
+                           : m_segments.back()->base +
+                                 m_segments.back()->num_docs;
+        s.m_num_terms = 0;
+        for (auto const& seg : m_segments) {
+            s.m_num_terms = std::max<uint64_t>(s.m_num_terms,
+                                               seg->lists.size());
+        }
+        return s;
+    }
+
+    // documents added so far, including the buffered ones
+    uint64_t num_docs() const {
+        return m_num_docs + m_buffer_docs;
+    }
+
+    statistics stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    // calls for_each_term(term, f) for each term, which in turn calls
+    // f(docs, freqs) if the term has postings
+    template <typename ForEachTerm>
+    void build_segment(segment& seg, size_t num_terms,
+                       ForEachTerm for_each_term) {
+        global_parameters params;
+        params.log_partition_size = m_conf.log_partition_size;
+        typename Index::builder builder(seg.num_docs, params);
+        seg.lists.assign(num_terms, absent);
+        seg.postings = 0;
+        uint32_t local_id = 0;
+        for (size_t term = 0; term < num_terms; ++term) {
+            for_each_term(term, [&](std::vector<uint32_t> const& docs,
+                                    std::vector<uint32_t> const& freqs) {
+                uint64_t occurrences =
+                    std::accumulate(freqs.begin(), freqs.end(), uint64_t(0));
+                builder.add_posting_list(docs.size(), docs.begin(),
+                                         freqs.begin(), occurrences, m_conf);
+                seg.lists[term] = local_id++;
+                seg.postings += docs.size();
+            });
+        }
+        if (local_id) {
+            builder.build(seg.index);
+        }
+    }
+
+    // first run of merge_factor adjacent segments with the same level, none
+    // of them being merged; returns (begin, length)
+    std::pair<size_t, size_t> find_merge() const {
+        size_t run = 0;
+        for (size_t i = 0; i < m_segments.size(); ++i) {
+            bool extends = run and !m_segments[i]->merging and
+                           m_segments[i]->level == m_segments[i - 1]->level;
+            run = extends ? run + 1 : (m_segments[i]->merging ? 0 : 1);
+            if (run == m_params.merge_factor) {
+                return {i + 1 - run, run};
+            }
+        }
+        return {0, 0};
+    }
+
+    void merge_loop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cond.wait(lock, [&] { return m_stop or find_merge().second; });
+            if (m_stop) return;
+
+            auto run = find_merge();
+            std::vector<segment_ptr> inputs(
+                m_segments.begin() + run.first,
+                m_segments.begin() + run.first + run.second);
+            for (auto& seg : inputs) {
+                seg->merging = true;
+            }
+            ++m_running_merges;
+            lock.unlock();
+
+            auto tick = get_time_usecs();
+            auto merged = merge(inputs);
+            double elapsed = (get_time_usecs() - tick) / 1000000;
+
+            lock.lock();
+            auto first = std::find(m_segments.begin(), m_segments.end(),
+                                   inputs.front());
+            *first = merged;
+            m_segments.erase(first + 1, first + inputs.size());
+            --m_running_merges;
+            m_stats.merges += 1;
+            m_stats.merged_postings += merged->postings;
+            m_stats.merge_time += elapsed;
+            m_idle_cond.notify_all();
+            m_cond.notify_all();
+        }
+    }
+
+    segment_ptr merge(std::vector<segment_ptr> const& inputs) {
+        auto seg = std::make_shared<segment>();
+        seg->base = inputs.front()->base;
+        seg->num_docs = 0;
+        seg->level = inputs.front()->level + 1;
+        seg->merging = false;
+        size_t num_terms = 0;
+        for (auto const& input : inputs) {
+            seg->num_docs += input->num_docs;
+            num_terms = std::max(num_terms, input->lists.size());
+        }
+
+        std::vector<uint32_t> docs, freqs;
+        build_segment(*seg, num_terms, [&](size_t term, auto f) {
+            docs.clear();
+            freqs.clear();
+            for (auto const& input : inputs) {
+                uint32_t list = input->list(term);
+                if (list == absent) continue;
+                uint32_t shift = input->base - seg->base;
+                auto e = input->index[list];
+                for (uint64_t i = 0; i < e.size(); ++i, e.next()) {
+                    docs.push_back(e.docid() + shift);
+                    freqs.push_back(e.freq());
+                }
+            }
+            if (!docs.empty()) {
+                f(docs, freqs);
+            }
+        });
+        return seg;
+    }
+
+    configuration const& m_conf;
+    parameters m_params;
+
+    // owned by the writer thread
+    uint64_t m_num_docs;
+    uint64_t m_buffer_docs;
+    std::vector<std::vector<uint32_t>> m_buffer_docids;
+    std::vector<std::vector<uint32_t>> m_buffer_freqs;
+
+    // guarded by m_mutex
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_idle_cond;
+    std::vector<segment_ptr> m_segments;
+    uint64_t m_running_merges;
+    bool m_stop;
+    statistics m_stats;
+
+    std::vector<std::thread> m_mergers;
+};
+
+template <typename Index>
+const uint32_t updatable_index<Index>::absent;
+
+}  // namespace pvb
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #include <map>
@@ -12,6 +13,8 @@
 #include <chrono>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "succinct/broadword.hpp"
 #include "succinct/bit_vector.hpp"
@@ -95,6 +98,40 @@ inline double get_user_time_usecs() {
     return double(ru.ru_utime.tv_sec) * 1000000 + double(ru.ru_utime.tv_usec);
 }
 
+// minor and major page faults of the process so far
+inline uint64_t get_page_faults() {
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt + ru.ru_majflt;
+}
+
+// Brings the pages spanned by [begin, begin + bytes) into memory: the kernel
+// is first asked to read them ahead in bulk, then one byte per page is
+// touched to map them in the page table.
+inline void warmup_range(const void* begin, uint64_t bytes) {
+    if (!bytes) return;
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t first = reinterpret_cast<uintptr_t>(begin) & ~(page_size - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(begin) + bytes;
+    madvise(reinterpret_cast<void*>(first), end - first, MADV_WILLNEED);
+    volatile char tmp;
+    for (uintptr_t p = first; p < end; p += page_size) {
+        tmp = *reinterpret_cast<const char*>(std::max(
+            p, reinterpret_cast<uintptr_t>(begin)));
+    }
+    (void)tmp;
+}
+
+// Same as above for the bits [begin, end) of a bit_vector
+inline void warmup_bits(succinct::bit_vector const& bv, uint64_t begin,
+                        uint64_t end) {
+    if (begin == end) return;
+    uint64_t first_word = begin / 64;
+    uint64_t last_word = (end - 1) / 64;
+    warmup_range(bv.data().data() + first_word,
+                 (last_word - first_word + 1) * sizeof(uint64_t));
+}
+
 template <class T>
 inline void do_not_optimize_away(T&& datum) {
     asm volatile("" : "+r"(datum));
@@ -116,6 +153,18 @@ struct has_next_geq {
 template <typename T>
 using if_has_next_geq = std::enable_if_t<has_next_geq<T>::value>;
 
+// Opens the document enumerator e for a full scan of its list, if it has a
+// scan mode (see partitioned_sequence_enumerator::open_scan); metadata is
+// the buffer it decodes into, and must outlive it
+template <typename Enum>
+auto open_scan(Enum& e, std::vector<uint64_t>& metadata)
+    -> decltype(e.open_scan(metadata)) {
+    e.open_scan(metadata);
+}
+
+template <typename Enum, typename... Unused>
+void open_scan(Enum&, std::vector<uint64_t>&, Unused...) {}
+
 // A more powerful version of boost::function_input_iterator that also works
 // with lambdas.
 //
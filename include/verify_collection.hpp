@@ -1,25 +1,37 @@
 #pragma once
 
 #include "succinct/mapper.hpp"
+#include "impacts.hpp"
+#include "term_directory.hpp"
 #include "util.hpp"
 
 using pvb::logger;
 
 namespace pvb {
 
-template <typename InputCollection, typename Collection>
-void verify_collection(InputCollection const& input, const char* filename) {
+// With a quantizer, the index stores impacts in place of the frequencies, and
+// is checked against the impacts of the input lists
+template <typename InputCollection, typename Collection,
+          typename Scorer = bm25>
+void verify_collection(InputCollection const& input, const char* filename,
+                       impact_quantizer<Scorer> const* quantizer = nullptr) {
     Collection coll;
     boost::iostreams::mapped_file_source m(filename);
-    succinct::mapper::map(coll, m);
+    // with its term directory, if it was saved with one
+    map_index(coll, m.data(), m.size());
 
     logger() << "Checking index..." << std::endl;
 
     size_t size = 0;
     size_t seq_id = 0;
+    std::vector<uint32_t> impacts;
 
     for (auto seq : input) {
         size = seq.docs.size();
+        if (quantizer) {
+            quantizer->quantize(size, seq.docs.begin(), seq.freqs.begin(),
+                                impacts);
+        }
 
         auto& params = coll.params();
         params.blocks[0] = 0;
@@ -34,7 +46,8 @@ void verify_collection(InputCollection const& input, const char* filename) {
 
         for (size_t i = 0; i < e.size(); ++i, e.next()) {
             uint64_t docid = *(seq.docs.begin() + i);
-            uint64_t freq = *(seq.freqs.begin() + i);
+            uint64_t freq =
+                quantizer ? impacts[i] : *(seq.freqs.begin() + i);
 
             if (docid != e.docid()) {
                 logger() << "docid in sequence " << seq_id
@@ -1,6 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
 #include <succinct/mappable_vector.hpp>
+#include <succinct/mapper.hpp>
 
 #include "binary_freq_collection.hpp"
 #include "bm25.hpp"
@@ -8,13 +15,25 @@
 
 namespace pvb {
 
+// With len_bits of 8 or 16, the normalized document lengths are not stored
+// as floats but as the ids of 2^len_bits buckets, which hold the same number
+// of documents each (or a single length, when there are few distinct
+// lengths). Each bucket stores its mean length and the length-dependent part
+// of the Scorer denominator, so that scoring a candidate takes a table
+// lookup instead of computing it.
+//
+// With a block_size, the lists are also cut in blocks of block_size postings
+// and the last docid and the max weight of each block are stored, so that
+// block_max_ranked_and_query can skip the docids whose blocks cannot score
+// enough to enter the top-k.
 template <typename Scorer = bm25>
 struct wand_data {
     wand_data() {}
 
     template <typename LengthsIterator>
     wand_data(LengthsIterator len_it, uint64_t num_docs,
-              binary_freq_collection const& coll) {
+              binary_freq_collection const& coll, uint64_t len_bits = 32,
+              uint64_t block_size = 0) {
         std::vector<float> norm_lens(num_docs);
         double lens_sum = 0;
         logger() << "Reading sizes..." << std::endl;
@@ -28,17 +47,44 @@ struct wand_data {
             norm_lens[i] /= avg_len;
         }
 
-        logger() << "Storing max weight for each list..." << std::endl;
+        if (len_bits == 8 or len_bits == 16) {
+            logger() << "Quantizing lengths to " << len_bits << " bits..."
+                     << std::endl;
+            quantize_lengths(norm_lens, len_bits);
+        } else if (len_bits == 32) {
+            m_norm_lens.steal(norm_lens);
+        } else {
+            throw std::invalid_argument("Lengths must take 8, 16 or 32 bits");
+        }
+
+        logger() << "Storing max weight for each list"
+                 << (block_size ? " and block" : "") << "..." << std::endl;
         std::vector<float> max_term_weight;
+        std::vector<uint64_t> block_offsets(1, 0);
+        std::vector<uint32_t> block_docids;
+        std::vector<float> block_max_weights;
         for (auto const& seq : coll) {
             float max_score = 0;
             for (size_t i = 0; i < seq.docs.size(); ++i) {
                 uint64_t docid = *(seq.docs.begin() + i);
                 uint64_t freq = *(seq.freqs.begin() + i);
-                float score = Scorer::doc_term_weight(freq, norm_lens[docid]);
+                float score = Scorer::doc_term_weight_denominator(
+                    freq, len_denominator(docid));
                 max_score = std::max(max_score, score);
+                if (!block_size) continue;
+                if (i % block_size == 0) {
+                    block_max_weights.push_back(score);
+                    block_docids.push_back(docid);
+                } else {
+                    block_max_weights.back() =
+                        std::max(block_max_weights.back(), score);
+                    block_docids.back() = docid;
+                }
             }
             max_term_weight.push_back(max_score);
+            if (block_size) {
+                block_offsets.push_back(block_docids.size());
+            }
             if ((max_term_weight.size() % 1000000) == 0) {
                 logger() << max_term_weight.size() << " list processed"
                          << std::endl;
@@ -46,31 +92,243 @@ struct wand_data {
         }
         logger() << max_term_weight.size() << " list processed" << std::endl;
 
-        m_norm_lens.steal(norm_lens);
         m_max_term_weight.steal(max_term_weight);
+        if (block_size) {
+            m_ext.block_offsets.steal(block_offsets);
+            m_ext.block_docids.steal(block_docids);
+            m_ext.block_max_weights.steal(block_max_weights);
+        }
+    }
+
+    // the blocks of a list, moved forward with next_geq: docid() is the
+    // last docid of the current block, and weight() its max weight
+    struct block_enumerator {
+        block_enumerator(uint32_t const* docids, float const* weights,
+                         uint64_t blocks)
+            : m_cur(docids), m_end(docids + blocks), m_weights(weights) {}
+
+        void DS2I_ALWAYSINLINE next_geq(uint64_t lower_bound) {
+            while (m_cur != m_end and *m_cur < lower_bound) {
+                ++m_cur;
+                ++m_weights;
+            }
+        }
+
+        // past the last block, the docids are all covered and can score 0
+        uint64_t docid() const {
+            return m_cur != m_end ? *m_cur : uint64_t(-1);
+        }
+
+        float weight() const {
+            return m_cur != m_end ? *m_weights : 0;
+        }
+
+    private:
+        uint32_t const* m_cur;
+        uint32_t const* m_end;
+        float const* m_weights;
+    };
+
+    bool has_block_max() const {
+        return m_ext.block_offsets.size() != 0;
+    }
+
+    block_enumerator block_max(uint64_t term_id) const {
+        assert(has_block_max());
+        uint64_t begin = m_ext.block_offsets[term_id];
+        return block_enumerator(m_ext.block_docids.data() + begin,
+                                m_ext.block_max_weights.data() + begin,
+                                m_ext.block_offsets[term_id + 1] - begin);
     }
 
     float norm_len(uint64_t doc_id) const {
+        if (m_ext.len_buckets8.size()) {
+            return m_ext.bucket_norm_lens[m_ext.len_buckets8[doc_id]];
+        }
+        if (m_ext.len_buckets16.size()) {
+            return m_ext.bucket_norm_lens[m_ext.len_buckets16[doc_id]];
+        }
         return m_norm_lens[doc_id];
     }
 
+    // Scorer::length_denominator(norm_len(doc_id))
+    float len_denominator(uint64_t doc_id) const {
+        if (m_ext.len_buckets8.size()) {
+            return m_ext.len_denominators[m_ext.len_buckets8[doc_id]];
+        }
+        if (m_ext.len_buckets16.size()) {
+            return m_ext.len_denominators[m_ext.len_buckets16[doc_id]];
+        }
+        return Scorer::length_denominator(m_norm_lens[doc_id]);
+    }
+
     float max_term_weight(uint64_t term_id) const {
         return m_max_term_weight[term_id];
     }
 
+    // bits per document length: 8, 16 or 32 (plain floats)
+    uint64_t len_bits() const {
+        if (m_ext.len_buckets8.size()) return 8;
+        if (m_ext.len_buckets16.size()) return 16;
+        return 32;
+    }
+
     void swap(wand_data& other) {
         m_norm_lens.swap(other.m_norm_lens);
         m_max_term_weight.swap(other.m_max_term_weight);
+        m_ext.swap(other.m_ext);
     }
 
+    // The files start with the layout of the wand data written before the
+    // length buckets and the block maxima were added, which can still be
+    // read; the vectors of these are appended only when they are used.
     template <typename Visitor>
     void map(Visitor& visit) {
         visit(m_norm_lens, "m_norm_lens")(m_max_term_weight,
                                           "m_max_term_weight");
     }
 
+    void save(const char* filename) {
+        std::ofstream fout(filename, std::ios::binary);
+        succinct::mapper::freeze(*this, fout);
+        if (!m_ext.empty()) {
+            succinct::mapper::freeze(m_ext, fout);
+        }
+    }
+
+    // maps a file written by save
+    void load(boost::iostreams::mapped_file_source const& m,
+              uint64_t flags = 0) {
+        size_t bytes = succinct::mapper::map(*this, m, flags);
+        if (bytes < m.size()) {
+            succinct::mapper::map(m_ext, m.data() + bytes, flags);
+        }
+    }
+
+    // bytes taken by the file written by save
+    uint64_t bytes() {
+        uint64_t bytes = succinct::mapper::size_of(*this);
+        if (!m_ext.empty()) {
+            bytes += succinct::mapper::size_of(m_ext);
+        }
+        return bytes;
+    }
+
+    // relative error of the quantized normalized lengths against the exact
+    // ones, computed when quantizing; documents of length 0 count as exact
+    // (0 with 32 bits, or for mapped wand data)
+    double avg_len_error() const {
+        return m_avg_len_error;
+    }
+
+    double max_len_error() const {
+        return m_max_len_error;
+    }
+
 private:
+    void quantize_lengths(std::vector<float> const& norm_lens,
+                          uint64_t len_bits) {
+        uint64_t num_docs = norm_lens.size();
+        uint64_t max_buckets = uint64_t(1) << len_bits;
+        std::vector<float> sorted(norm_lens);
+        std::sort(sorted.begin(), sorted.end());
+
+        // smallest length of each bucket
+        std::vector<float> lower_bounds(sorted);
+        lower_bounds.erase(
+            std::unique(lower_bounds.begin(), lower_bounds.end()),
+            lower_bounds.end());
+        if (lower_bounds.size() > max_buckets) {
+            lower_bounds.clear();
+            for (uint64_t i = 0; i < max_buckets; ++i) {
+                float len = sorted[i * num_docs / max_buckets];
+                if (lower_bounds.empty() or len > lower_bounds.back()) {
+                    lower_bounds.push_back(len);
+                }
+            }
+        }
+
+        uint64_t buckets = lower_bounds.size();
+        std::vector<uint32_t> ids(num_docs);
+        std::vector<double> sums(buckets, 0);
+        std::vector<uint64_t> counts(buckets, 0);
+        for (uint64_t i = 0; i < num_docs; ++i) {
+            ids[i] = std::upper_bound(lower_bounds.begin(), lower_bounds.end(),
+                                      norm_lens[i]) -
+                     lower_bounds.begin() - 1;
+            sums[ids[i]] += norm_lens[i];
+            counts[ids[i]] += 1;
+        }
+
+        std::vector<float> bucket_norm_lens(buckets);
+        std::vector<float> denominators(buckets);
+        for (uint64_t b = 0; b < buckets; ++b) {
+            bucket_norm_lens[b] = float(sums[b] / counts[b]);
+            denominators[b] = Scorer::length_denominator(bucket_norm_lens[b]);
+        }
+        double error_sum = 0;
+        for (uint64_t i = 0; i < num_docs; ++i) {
+            if (norm_lens[i] == 0) continue;
+            double error = std::fabs(bucket_norm_lens[ids[i]] - norm_lens[i]) /
+                           norm_lens[i];
+            m_max_len_error = std::max(m_max_len_error, error);
+            error_sum += error;
+        }
+        m_avg_len_error = error_sum / num_docs;
+
+        m_ext.bucket_norm_lens.steal(bucket_norm_lens);
+        m_ext.len_denominators.steal(denominators);
+
+        if (len_bits == 8) {
+            std::vector<uint8_t> buckets8(ids.begin(), ids.end());
+            m_ext.len_buckets8.steal(buckets8);
+        } else {
+            std::vector<uint16_t> buckets16(ids.begin(), ids.end());
+            m_ext.len_buckets16.steal(buckets16);
+        }
+    }
+
     succinct::mapper::mappable_vector<float> m_norm_lens;
     succinct::mapper::mappable_vector<float> m_max_term_weight;
+
+    // length buckets and block maxima, stored after the legacy layout
+    struct extensions {
+        bool empty() const {
+            return len_buckets8.size() == 0 and len_buckets16.size() == 0 and
+                   block_offsets.size() == 0;
+        }
+
+        void swap(extensions& other) {
+            len_buckets8.swap(other.len_buckets8);
+            len_buckets16.swap(other.len_buckets16);
+            bucket_norm_lens.swap(other.bucket_norm_lens);
+            len_denominators.swap(other.len_denominators);
+            block_offsets.swap(other.block_offsets);
+            block_docids.swap(other.block_docids);
+            block_max_weights.swap(other.block_max_weights);
+        }
+
+        template <typename Visitor>
+        void map(Visitor& visit) {
+            visit(len_buckets8, "len_buckets8")(len_buckets16,
+                                                "len_buckets16")(
+                bucket_norm_lens, "bucket_norm_lens")(len_denominators,
+                                                      "len_denominators")(
+                block_offsets, "block_offsets")(block_docids, "block_docids")(
+                block_max_weights, "block_max_weights");
+        }
+
+        succinct::mapper::mappable_vector<uint8_t> len_buckets8;
+        succinct::mapper::mappable_vector<uint16_t> len_buckets16;
+        succinct::mapper::mappable_vector<float> bucket_norm_lens;
+        succinct::mapper::mappable_vector<float> len_denominators;
+        succinct::mapper::mappable_vector<uint64_t> block_offsets;
+        succinct::mapper::mappable_vector<uint32_t> block_docids;
+        succinct::mapper::mappable_vector<float> block_max_weights;
+    };
+
+    extensions m_ext;
+    double m_avg_len_error = 0;
+    double m_max_len_error = 0;
 };
 }  // namespace pvb
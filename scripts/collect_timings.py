@@ -6,7 +6,7 @@ path_to_results = sys.argv[3]  # e.g., './results'
 prefix_name = sys.argv[4]      # e.g., 'gov2'
 query_log = sys.argv[5]
 
-index_types = ["opt_vb_dp", "uniform_vb", "opt_vb"
+index_types = ["opt_vb_dp", "uniform_vb", "opt_vb", "opt_vb_runs"
                 ,
                "block_maskedvbyte", "block_streamvbyte",
                "block_varintgb", "block_varintg8iu"]
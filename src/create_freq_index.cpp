@@ -1,16 +1,21 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <thread>
+#include <type_traits>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/optional.hpp>
 
 #include "succinct/mapper.hpp"
 
+#include "binary_collection.hpp"
 #include "bm25.hpp"
 #include "configuration.hpp"
+#include "cpu_features.hpp"
+#include "impacts.hpp"
 #include "index_build_utils.hpp"
 #include "types.hpp"
 #include "util.hpp"
@@ -22,12 +27,22 @@ using pvb::logger;
 template <typename Collection>
 void dump_index_specific_stats(Collection const&, std::string const&) {}
 
+// whether the builder of the index only stores pointers to the lists until
+// build() is called, instead of compressing them when they are added
+template <typename Collection>
+struct builder_keeps_lists : std::false_type {};
+
+template <typename Index>
+struct builder_keeps_lists<sharded_index<Index>> : std::true_type {};
+
 template <typename InputCollection, typename CollectionType,
           typename Scorer = bm25>
 void create_collection(InputCollection const& input,
                        global_parameters const& params,
                        configuration const& conf, const char* output_filename,
-                       bool check, std::string const& seq_type) {
+                       bool check, bool directory,
+                       std::string const& seq_type,
+                       impact_quantizer<Scorer> const* quantizer) {
     logger() << "Building index with F = " << conf.fix_cost << std::endl;
     logger() << "Processing " << input.num_docs() << " documents" << std::endl;
     double tick = get_time_usecs();
@@ -36,14 +51,31 @@ void create_collection(InputCollection const& input,
     typename CollectionType::builder builder(input.num_docs(), params);
     progress_logger plog;
     uint64_t size = 0;
+    std::vector<uint32_t> impacts;
+    // the impacts of all the lists, when the builder keeps pointers to them
+    std::vector<std::vector<uint32_t>> kept_impacts;
 
     for (auto const& plist : input) {
         size = plist.docs.size();
         uint64_t freqs_sum = 0;
-        freqs_sum = std::accumulate(plist.freqs.begin(),
-                                    plist.freqs.begin() + size, uint64_t(0));
-        builder.add_posting_list(size, plist.docs.begin(), plist.freqs.begin(),
-                                 freqs_sum, conf);
+        if (quantizer) {
+            quantizer->quantize(size, plist.docs.begin(), plist.freqs.begin(),
+                                impacts);
+            freqs_sum =
+                std::accumulate(impacts.begin(), impacts.end(), uint64_t(0));
+            builder.add_posting_list(size, plist.docs.begin(), impacts.data(),
+                                     freqs_sum, conf);
+            if (builder_keeps_lists<CollectionType>::value) {
+                kept_impacts.emplace_back();
+                kept_impacts.back().swap(impacts);
+            }
+        } else {
+            freqs_sum = std::accumulate(plist.freqs.begin(),
+                                        plist.freqs.begin() + size,
+                                        uint64_t(0));
+            builder.add_posting_list(size, plist.docs.begin(),
+                                     plist.freqs.begin(), freqs_sum, conf);
+        }
         plog.done_sequence(size);
     }
 
@@ -55,22 +87,37 @@ void create_collection(InputCollection const& input,
 
     logger() << seq_type << " collection built in " << elapsed_secs
              << " seconds" << std::endl;
-    stats_line()("type", seq_type)("worker_threads", conf.worker_threads)(
+    stats_line()("type", seq_type)("isa", cpu_features::get().isa_name())(
+        "worker_threads", conf.worker_threads)(
         "construction_time", elapsed_secs)("construction_user_time",
                                            user_elapsed_secs);
+    if (quantizer) {
+        logger() << "Frequencies replaced by impacts, of "
+                 << quantizer->score_unit() << " each" << std::endl;
+        stats_line()("type", seq_type)("impact_score_unit",
+                                       quantizer->score_unit());
+    }
 
     dump_stats(coll, seq_type, plog.postings);
 
+    if (directory) {
+        coll.build_term_directory();
+        logger() << "Term directory: " << coll.term_directory_size()
+                 << " bytes" << std::endl;
+        stats_line()("type", seq_type)("term_directory_size",
+                                       coll.term_directory_size());
+    }
+
     if (output_filename) {
         logger() << "saving index on disk" << std::endl;
         double tick = get_time_usecs();
-        succinct::mapper::freeze(coll, output_filename);
+        save_index(coll, output_filename);
         double elapsed_secs = (get_time_usecs() - tick) / 1000000;
         logger() << "done in " << elapsed_secs << " seconds" << std::endl;
 
         if (check) {
-            verify_collection<InputCollection, CollectionType>(input,
-                                                               output_filename);
+            verify_collection<InputCollection, CollectionType>(
+                input, output_filename, quantizer);
         }
     }
 }
@@ -79,7 +126,8 @@ int main(int argc, char** argv) {
     if (argc < 3) {
         std::cerr << "Usage " << argv[0] << ":\n"
                   << "\t<index_type> <collection_basename> [--out "
-                     "<output_filename>] [--F <fix_cost>] [--check]"
+                     "<output_filename>] [--F <fix_cost>] [--check] "
+                     "[--directory] [--impacts]"
                   << std::endl;
         return 1;
     }
@@ -89,6 +137,8 @@ int main(int argc, char** argv) {
     const char* output_filename = nullptr;
     uint64_t F = 64;
     bool check = false;
+    bool directory = false;
+    bool impacts = false;
 
     for (int i = 3; i < argc; ++i) {
         if (argv[i] == std::string("--out")) {
@@ -97,6 +147,10 @@ int main(int argc, char** argv) {
             F = std::stoull(argv[++i]);
         } else if (argv[i] == std::string("--check")) {
             check = true;
+        } else if (argv[i] == std::string("--directory")) {
+            directory = true;
+        } else if (argv[i] == std::string("--impacts")) {
+            impacts = true;
         } else {
             std::cerr << "Unknown parameter" << std::endl;
             return 1;
@@ -104,6 +158,14 @@ int main(int argc, char** argv) {
     }
 
     binary_freq_collection input(collection_basename);
+    std::unique_ptr<impact_quantizer<>> quantizer;
+    if (impacts) {
+        logger() << "Computing impacts" << std::endl;
+        binary_collection sizes_coll(
+            (std::string(collection_basename) + ".sizes").c_str());
+        quantizer.reset(
+            new impact_quantizer<>(sizes_coll.begin()->begin(), input));
+    }
 
     configuration conf(F);
     global_parameters params;
@@ -114,9 +176,10 @@ int main(int argc, char** argv) {
     }                                                                       \
     else if (type == BOOST_PP_STRINGIZE(T)) {                               \
         create_collection<binary_freq_collection, BOOST_PP_CAT(T, _index)>( \
-            input, params, conf, output_filename, check, type);
+            input, params, conf, output_filename, check, directory, type,   \
+            quantizer.get());
 
-        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_INDEX_TYPES);
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_ALL_INDEX_TYPES);
 #undef LOOP_BODY
     } else {
         logger() << "ERROR: Unknown type " << type << std::endl;
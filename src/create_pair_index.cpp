@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "succinct/mapper.hpp"
+
+#include "binary_freq_collection.hpp"
+#include "configuration.hpp"
+#include "pair_index.hpp"
+#include "queries.hpp"
+#include "types.hpp"
+#include "util.hpp"
+
+using namespace pvb;
+
+struct term_pair {
+    uint32_t a;
+    uint32_t b;
+    uint64_t count;  // queries containing both terms
+    std::vector<uint32_t> docs;
+};
+
+// the max_pairs pairs of terms appearing together in at least min_count
+// queries of the log, most frequent first
+std::vector<term_pair> frequent_pairs(const char* query_filename,
+                                      uint64_t max_pairs,
+                                      uint64_t min_count) {
+    std::unordered_map<uint64_t, uint64_t> counts;
+    std::ifstream is(query_filename);
+    term_id_vec query;
+    uint64_t queries = 0;
+    while (read_query(query, is)) {
+        remove_duplicate_terms(query);
+        for (size_t i = 0; i < query.size(); ++i) {
+            for (size_t j = i + 1; j < query.size(); ++j) {
+                counts[(uint64_t(query[i]) << 32) | query[j]] += 1;
+            }
+        }
+        ++queries;
+    }
+    logger() << queries << " queries, " << counts.size()
+             << " distinct pairs of terms" << std::endl;
+
+    std::vector<term_pair> pairs;
+    for (auto const& c : counts) {
+        if (c.second >= min_count) {
+            pairs.push_back(term_pair{uint32_t(c.first >> 32),
+                                      uint32_t(c.first), c.second, {}});
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(),
+              [](term_pair const& lhs, term_pair const& rhs) {
+                  return lhs.count > rhs.count or
+                         (lhs.count == rhs.count and
+                          std::make_pair(lhs.a, lhs.b) <
+                              std::make_pair(rhs.a, rhs.b));
+              });
+    if (pairs.size() > max_pairs) {
+        pairs.resize(max_pairs);
+    }
+    return pairs;
+}
+
+// intersects the lists of each pair, reading the collection once
+uint64_t intersect_pairs(binary_freq_collection const& coll,
+                         std::vector<term_pair>& pairs) {
+    std::unordered_set<uint32_t> terms;
+    for (auto const& p : pairs) {
+        terms.insert(p.a);
+        terms.insert(p.b);
+    }
+    std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+    uint32_t term = 0;
+    for (auto const& seq : coll) {
+        if (terms.count(term)) {
+            lists[term].assign(seq.docs.begin(), seq.docs.end());
+        }
+        ++term;
+    }
+
+    uint64_t input_postings = 0;
+    for (auto& p : pairs) {
+        auto const& a = lists[p.a];
+        auto const& b = lists[p.b];
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                              std::back_inserter(p.docs));
+        input_postings += a.size() + b.size();
+    }
+    return input_postings;
+}
+
+template <typename Index>
+void create_pair_index(std::vector<term_pair>& pairs, uint64_t num_docs,
+                       uint64_t input_postings, global_parameters const& params,
+                       configuration const& conf, std::string const& type,
+                       const char* output_filename) {
+    typename pair_index<Index>::builder builder(num_docs, params);
+    uint64_t pair_postings = 0;
+    uint64_t empty_pairs = 0;
+    for (auto& p : pairs) {
+        pair_postings += p.docs.size();
+        empty_pairs += p.docs.empty();
+        builder.add_pair(p.a, p.b, std::move(p.docs));
+    }
+    pair_index<Index> index;
+    builder.build(index, conf);
+
+    uint64_t bytes = succinct::mapper::size_of(index);
+    logger() << index.size() << " pairs (" << empty_pairs
+             << " with no common documents), " << pair_postings
+             << " postings in " << bytes << " bytes, replacing "
+             << input_postings << " postings of the term lists" << std::endl;
+    stats_line()("type", type)("pairs", index.size())(
+        "empty_pairs", empty_pairs)("pair_postings", pair_postings)(
+        "term_postings", input_postings)("pair_index_bytes", bytes)(
+        "bits_per_pair_posting",
+        pair_postings ? double(8 * bytes) / pair_postings : 0);
+
+    logger() << "Saving " << output_filename << std::endl;
+    succinct::mapper::freeze(index, output_filename);
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 5) {
+        std::cerr << "Usage " << argv[0] << ":\n\t"
+                  << "<index_type> <collection_basename> <query_filename> "
+                     "<output_filename> [--pairs <max_pairs>] [--min-count "
+                     "<min_count>]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    const char* collection_basename = argv[2];
+    const char* query_filename = argv[3];
+    const char* output_filename = argv[4];
+    uint64_t max_pairs = 1000;
+    uint64_t min_count = 2;
+
+    for (int i = 5; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--pairs") {
+            max_pairs = std::stoull(argv[++i]);
+        } else if (arg == "--min-count") {
+            min_count = std::stoull(argv[++i]);
+        } else {
+            logger() << "ERROR: Unknown option '" << arg << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    auto pairs = frequent_pairs(query_filename, max_pairs, min_count);
+    logger() << "Intersecting " << pairs.size() << " pairs" << std::endl;
+    binary_freq_collection coll(collection_basename);
+    uint64_t input_postings = intersect_pairs(coll, pairs);
+
+    configuration conf(64);
+    global_parameters params;
+    params.log_partition_size = conf.log_partition_size;
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                               \
+    }                                                                       \
+    else if (type == BOOST_PP_STRINGIZE(T)) {                               \
+        create_pair_index<BOOST_PP_CAT(T, _index)>(                         \
+            pairs, coll.num_docs(), input_postings, params, conf, type,     \
+            output_filename);
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown type " << type << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
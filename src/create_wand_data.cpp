@@ -10,18 +10,55 @@
 int main(int argc, const char** argv) {
     using namespace pvb;
 
-    if (argc != 3) {
+    if (argc < 3) {
         std::cerr << "Usage " << argv[0] << ":\n\t"
-                  << "<collection_basename> <output_filename>" << std::endl;
+                  << "<collection_basename> <output_filename> [--len-bits "
+                     "8|16] [--block-size postings]"
+                  << std::endl;
         return 1;
     }
 
     std::string input_basename = argv[1];
     const char* output_filename = argv[2];
+    uint64_t len_bits = 32;
+    uint64_t block_size = 0;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--len-bits") {
+            len_bits = std::stoull(argv[++i]);
+            if (len_bits != 8 and len_bits != 16) {
+                logger() << "ERROR: --len-bits must be 8 or 16" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--block-size") {
+            block_size = std::stoull(argv[++i]);
+            if (!block_size) {
+                logger() << "ERROR: --block-size must be positive"
+                         << std::endl;
+                return 1;
+            }
+        } else {
+            logger() << "ERROR: Unknown option '" << arg << "'." << std::endl;
+            return 1;
+        }
+    }
 
     binary_collection sizes_coll((input_basename + ".sizes").c_str());
     binary_freq_collection coll(input_basename.c_str());
 
-    wand_data<> wdata(sizes_coll.begin()->begin(), coll.num_docs(), coll);
-    succinct::mapper::freeze(wdata, output_filename);
+    wand_data<> wdata(sizes_coll.begin()->begin(), coll.num_docs(), coll,
+                      len_bits, block_size);
+
+    uint64_t bytes = wdata.bytes();
+    logger() << "Wand data takes " << bytes << " bytes, "
+             << double(bytes) / coll.num_docs() << " bytes per document"
+             << std::endl;
+    stats_line()("len_bits", len_bits)("block_size", block_size)(
+        "wand_data_bytes", bytes)(
+        "bytes_per_doc", double(bytes) / coll.num_docs())(
+        "avg_len_error", wdata.avg_len_error())("max_len_error",
+                                                wdata.max_len_error());
+
+    wdata.save(output_filename);
 }
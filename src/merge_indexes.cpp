@@ -0,0 +1,166 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "succinct/mapper.hpp"
+
+#include "configuration.hpp"
+#include "index_merge.hpp"
+#include "types.hpp"
+#include "util.hpp"
+#include "verify_collection.hpp"
+
+using namespace pvb;
+
+typedef opt_vb_merger<maskedvbyte_block<>> merger_type;
+typedef merger_type::index_type index_type;
+
+// the merge done by decoding the lists and building the index again, for
+// comparison
+void rebuild(index_type& a, index_type& b, index_type& out,
+             configuration const& conf) {
+    index_type::builder builder(a.num_docs() + b.num_docs(), a.params());
+    std::vector<uint32_t> docs, freqs;
+    uint64_t lists = std::max(a.size(), b.size());
+    for (uint64_t i = 0; i < lists; ++i) {
+        docs.clear();
+        freqs.clear();
+        uint64_t occurrences = 0;
+        for (auto index : {&a, &b}) {
+            if (i >= index->size()) continue;
+            uint64_t shift = index == &b ? a.num_docs() : 0;
+            auto e = (*index)[i];
+            for (uint64_t j = 0; j < e.size(); ++j, e.next()) {
+                docs.push_back(e.docid() + shift);
+                freqs.push_back(e.freq());
+                occurrences += freqs.back();
+            }
+        }
+        builder.add_posting_list(docs.size(), docs.begin(), freqs.begin(),
+                                 occurrences, conf);
+    }
+    builder.build(out);
+}
+
+// Checks the lists present in both indexes against their lists in a and b.
+// The lists that end early in a, before its last document, and start with
+// a bitmap partition in b are counted apart, as the merge encodes that
+// partition again from the last docid of a.
+void check_merged_lists(index_type& a, index_type& b, index_type& merged) {
+    uint64_t lists = std::min(a.size(), b.size());
+    uint64_t bitmap_heads = 0, errors = 0;
+    for (uint64_t i = 0; i < lists; ++i) {
+        auto e = merged[i];
+        auto a_enum = a[i];
+        auto b_enum = b[i];
+        if (b_enum.partition_bitmap()) {
+            auto a_last = a[i];
+            a_last.move(a_last.size() - 1);
+            if (a_last.docid() + 1 < a.num_docs()) {
+                bitmap_heads += 1;
+            }
+        }
+
+        bool ok = e.size() == a_enum.size() + b_enum.size();
+        for (uint64_t j = 0; ok and j < a_enum.size(); ++j, a_enum.next()) {
+            ok = e.docid() == a_enum.docid() and e.freq() == a_enum.freq();
+            e.next();
+        }
+        for (uint64_t j = 0; ok and j < b_enum.size(); ++j, b_enum.next()) {
+            ok = e.docid() == b_enum.docid() + a.num_docs() and
+                 e.freq() == b_enum.freq();
+            e.next();
+        }
+        if (!ok) {
+            logger() << "ERROR: merged list " << i << " differs from its lists"
+                     << std::endl;
+            errors += 1;
+        }
+    }
+    logger() << "Checked " << lists << " merged lists, " << bitmap_heads
+             << " of them ending early in the first index and starting with "
+                "a bitmap in the second"
+             << std::endl;
+    stats_line()("type", "opt_vb")("checked_lists", lists)(
+        "bitmap_heads", bitmap_heads)("errors", errors);
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage " << argv[0] << ":\n\t"
+                  << "<index_a> <index_b> <output_filename> [--check "
+                     "collection_basename] [--compare]"
+                  << std::endl;
+        return 1;
+    }
+
+    const char* a_filename = argv[1];
+    const char* b_filename = argv[2];
+    const char* output_filename = argv[3];
+    const char* check_basename = nullptr;
+    bool compare = false;
+
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--check") {
+            check_basename = argv[++i];
+        } else if (arg == "--compare") {
+            compare = true;
+        } else {
+            logger() << "ERROR: Unknown option '" << arg << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    index_type a, b;
+    boost::iostreams::mapped_file_source ma(a_filename);
+    succinct::mapper::map(a, ma);
+    boost::iostreams::mapped_file_source mb(b_filename);
+    succinct::mapper::map(b, mb);
+    logger() << "Merging " << a.size() << " lists over " << a.num_docs()
+             << " documents with " << b.size() << " lists over "
+             << b.num_docs() << " documents" << std::endl;
+
+    configuration conf(64);
+    double tick = get_time_usecs();
+    merger_type merger(a, b, conf);
+    index_type merged;
+    merger.merge(merged);
+    double merge_secs = (get_time_usecs() - tick) / 1000000;
+
+    auto const& stats = merger.stats();
+    double output_mb = double(stats.output_bits) / 8 / (1 << 20);
+    logger() << "Merged in " << merge_secs << " seconds ("
+             << output_mb / merge_secs << " MB/s), "
+             << 100.0 * stats.copied_bits / stats.output_bits
+             << "% of the bits copied" << std::endl;
+    stats_line()("type", "opt_vb")("lists", stats.lists)(
+        "merged_lists", stats.merged_lists)("postings", stats.postings)(
+        "copied_bits", stats.copied_bits)("output_bits", stats.output_bits)(
+        "merge_time", merge_secs)("merge_mb_per_sec", output_mb / merge_secs);
+
+    if (compare) {
+        tick = get_time_usecs();
+        index_type rebuilt;
+        rebuild(a, b, rebuilt, conf);
+        double rebuild_secs = (get_time_usecs() - tick) / 1000000;
+        uint64_t rebuilt_bytes = succinct::mapper::size_of(rebuilt);
+        uint64_t merged_bytes = succinct::mapper::size_of(merged);
+        logger() << "Rebuilt in " << rebuild_secs << " seconds ("
+                 << rebuild_secs / merge_secs << "x), merged index is "
+                 << 100.0 * merged_bytes / rebuilt_bytes - 100
+                 << "% larger" << std::endl;
+        stats_line()("type", "opt_vb")("rebuild_time", rebuild_secs)(
+            "merged_bytes", merged_bytes)("rebuilt_bytes", rebuilt_bytes);
+    }
+
+    logger() << "Saving " << output_filename << std::endl;
+    succinct::mapper::freeze(merged, output_filename);
+
+    if (check_basename) {
+        check_merged_lists(a, b, merged);
+        binary_freq_collection input(check_basename);
+        verify_collection<binary_freq_collection, index_type>(
+            input, output_filename);
+    }
+}
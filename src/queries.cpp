@@ -1,4 +1,6 @@
 #include <iostream>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -6,8 +8,16 @@
 
 #include "succinct/mapper.hpp"
 
+#include "batch_queries.hpp"
+#include "cpu_features.hpp"
+#include "index_file.hpp"
+#include "intersection_planner.hpp"
+#include "list_cache.hpp"
+#include "pair_index.hpp"
 #include "types.hpp"
 #include "queries.hpp"
+#include "result_cache.hpp"
+#include "union_queries.hpp"
 #include "util.hpp"
 
 using namespace pvb;
@@ -36,11 +46,14 @@ void print_selective_queries(IndexType& index,
     }
 }
 
+// returns the mean query time in milliseconds
 template <typename Functor>
-void op_perftest(Functor query_func, std::vector<term_id_vec> const& queries,
+double op_perftest(Functor query_func, std::vector<term_id_vec> const& queries,
                  std::string const& index_type, std::string const& query_type,
-                 size_t runs) {
+                 index_file const& file, size_t runs) {
     std::vector<double> query_times;
+    double cold_time = 0;
+    uint64_t cold_page_faults = get_page_faults();
 
     for (size_t run = 0; run <= runs; ++run) {
         for (auto const& query : queries) {
@@ -50,8 +63,13 @@ void op_perftest(Functor query_func, std::vector<term_id_vec> const& queries,
             double elapsed = double(get_time_usecs() - tick);
             if (run != 0) {  // first run is not timed
                 query_times.push_back(elapsed);
+            } else {
+                cold_time += elapsed;
             }
         }
+        if (run == 0) {
+            cold_page_faults = get_page_faults() - cold_page_faults;
+        }
     }
 
     if (false) {
@@ -69,37 +87,222 @@ void op_perftest(Functor query_func, std::vector<term_id_vec> const& queries,
                  << std::endl;
         avg /= 1000;
         logger() << "Mean: " << avg << " [ms]" << std::endl;
-        stats_line()("type", index_type)("query", query_type)("avg", avg);
+        double cold_avg = cold_time / 1000 / queries.size();
+        stats_line()("type", index_type)("query", query_type)(
+            "isa", cpu_features::get().isa_name())("pages", file.mode())(
+            "load_time", file.load_time())("avg", avg)("cold_avg", cold_avg)(
+            "cold_page_faults", cold_page_faults);
+        return avg;
+    }
+    return 0;
+}
+
+// warms up the lists of the terms appearing in the queries, distributing them
+// across threads
+template <typename IndexType>
+void warmup_query_terms(IndexType const& index,
+                        std::vector<term_id_vec> const& queries,
+                        size_t threads) {
+    std::unordered_set<term_id_type> unique_terms;
+    for (auto const& q : queries) {
+        unique_terms.insert(q.begin(), q.end());
+    }
+    std::vector<term_id_type> terms(unique_terms.begin(), unique_terms.end());
+    threads = std::max<size_t>(1, std::min(threads, terms.size()));
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            for (size_t i = t; i < terms.size(); i += threads) {
+                index.warmup(terms[i]);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+// the function running the queries of query_type on index, or an empty
+// function if they cannot be performed
+template <typename IndexType>
+std::function<uint64_t(term_id_vec)> query_function(
+    IndexType& index, std::string const& query_type, uint64_t k,
+    wand_data<> const* wdata, bool impacts) {
+    std::function<uint64_t(term_id_vec)> query_fun;
+
+    if (query_type == "and") {
+        query_fun = [&index](term_id_vec query) {
+            return and_query()(index, query);
+        };
+    } else if (query_type == "adaptive_and") {
+        query_fun = [&index](term_id_vec query) {
+            return adaptive_and_query()(index, query);
+        };
+    } else if (query_type == "or") {
+        query_fun = [&index](term_id_vec query) {
+            return or_query()(index, query);
+        };
+    } else if (query_type == "fast_or") {
+        query_fun = [&index](term_id_vec query) {
+            return fast_or_query()(index, query);
+        };
+    } else if (query_type == "ranked_and" and impacts) {
+        logger() << "top-" << k << " results, scored with the impacts"
+                 << std::endl;
+        query_fun = [&index, k](term_id_vec query) {
+            return impact_ranked_and_query(k)(index, query);
+        };
+    } else if (query_type == "ranked_and") {
+        if (wdata) {
+            logger() << "top-" << k << " results" << std::endl;
+            query_fun = [&index, wdata, k](term_id_vec query) {
+                return ranked_and_query(*wdata, k)(index, query);
+            };
+        } else {
+            logger()
+                << "You must provide wand data to perform ranked_and queries."
+                << std::endl;
+        }
+    } else if (query_type == "block_max_ranked_and") {
+        if (wdata and wdata->has_block_max()) {
+            logger() << "top-" << k << " results" << std::endl;
+            query_fun = [&index, wdata, k](term_id_vec query) {
+                return block_max_ranked_and_query(*wdata, k)(index, query);
+            };
+        } else {
+            logger() << "You must provide wand data built with --block-size "
+                        "to perform block_max_ranked_and queries."
+                     << std::endl;
+        }
+    } else {
+        logger() << "Unsupported query type: " << query_type << std::endl;
+    }
+
+    return query_fun;
+}
+
+typedef std::vector<scored_docid_type> topk_type;
+
+template <typename Query, typename IndexType>
+uint64_t cached_ranked_query(Query query, IndexType& index,
+                             term_id_vec const& terms,
+                             result_cache<topk_type>& cache) {
+    auto key = cache.query_key(terms, true);
+    topk_type topk;
+    if (!cache.find(key, topk)) {
+        query(index, terms);
+        topk = query.topk();
+        cache.insert(key, topk);
+    }
+    return topk.size();
+}
+
+// as query_function, but the and counts and the ranked top-k lists are
+// looked up in the caches before computing them
+template <typename IndexType>
+std::function<uint64_t(term_id_vec)> cached_query_function(
+    IndexType& index, std::string const& query_type, uint64_t k,
+    wand_data<> const* wdata, bool impacts, result_cache<uint64_t>& counts,
+    result_cache<topk_type>& topks) {
+    if (query_type == "and") {
+        return [&index, &counts](term_id_vec query) {
+            auto key = counts.query_key(query, false);
+            uint64_t results;
+            if (!counts.find(key, results)) {
+                results = and_query()(index, query);
+                counts.insert(key, results);
+            }
+            return results;
+        };
+    }
+    if (impacts) {
+        return [&index, &topks, k](term_id_vec query) {
+            return cached_ranked_query(impact_ranked_and_query(k), index,
+                                       query, topks);
+        };
+    }
+    return [&index, &topks, wdata, k](term_id_vec query) {
+        return cached_ranked_query(ranked_and_query(*wdata, k), index, query,
+                                   topks);
+    };
+}
+
+// runs the queries once, in order, as a replayed query log, and returns the
+// queries per second
+template <typename Functor>
+double replay(Functor query_func, std::vector<term_id_vec> const& queries) {
+    auto tick = get_time_usecs();
+    for (auto const& query : queries) {
+        uint64_t result = query_func(query);
+        do_not_optimize_away(result);
+    }
+    double elapsed_secs = (get_time_usecs() - tick) / 1000000;
+    return queries.size() / elapsed_secs;
+}
+
+// runs the queries in batches of batch_size, each with its lists shared by
+// all its queries, and returns the queries per second
+template <typename IndexType>
+double batch_replay(IndexType& index, std::vector<term_id_vec> const& queries,
+                    std::string const& query_type, wand_data<> const& wdata,
+                    uint64_t k, uint64_t batch_size) {
+    auto tick = get_time_usecs();
+    for (size_t begin = 0; begin < queries.size(); begin += batch_size) {
+        size_t end = std::min<size_t>(begin + batch_size, queries.size());
+        std::vector<term_id_vec> batch(queries.begin() + begin,
+                                       queries.begin() + end);
+        if (query_type == "and") {
+            auto results = batch_and_query()(index, batch);
+            do_not_optimize_away(results.back());
+        } else {
+            auto results = batch_ranked_and_query(wdata, k)(index, batch);
+            do_not_optimize_away(results.back().size());
+        }
     }
+    double elapsed_secs = (get_time_usecs() - tick) / 1000000;
+    return queries.size() / elapsed_secs;
 }
 
 template <typename IndexType>
 void perftest(const char* index_filename, const char* wand_data_filename,
               std::vector<term_id_vec> const& queries,
               std::string const& index_type, std::string const& query_type,
-              uint64_t k) {
+              uint64_t k, bool hugepages, std::string const& warmup,
+              size_t threads, bool impacts, uint64_t cache_mb,
+              std::string const& cache_policy, uint64_t result_cache_entries,
+              const char* pairs_filename, uint64_t batch_size,
+              bool trace_plans) {
     IndexType index;
     logger() << "Loading index" << std::endl;
-    boost::iostreams::mapped_file_source m(index_filename);
-    succinct::mapper::map(index, m);
+    index_file file(index_filename, hugepages, threads);
+    map_index(index, file.data(), file.size());
+    logger() << "Index loaded in " << file.load_time() << " [sec] ("
+             << file.mode() << ")" << std::endl;
 
-    logger() << "Warming up posting lists" << std::endl;
-    std::unordered_set<term_id_type> warmed_up;
-    for (auto const& q : queries) {
-        for (auto t : q) {
-            if (!warmed_up.count(t)) {
-                index.warmup(t);
-                warmed_up.insert(t);
-            }
-        }
+    double warmup_time = 0;
+    if (warmup == "full") {
+        logger() << "Warming up the whole index with " << threads
+                 << " threads" << std::endl;
+        warmup_time = file.warmup(threads);
+    } else if (warmup == "queries") {
+        logger() << "Warming up posting lists with " << threads << " threads"
+                 << std::endl;
+        auto tick = get_time_usecs();
+        warmup_query_terms(index, queries, threads);
+        warmup_time = (get_time_usecs() - tick) / 1000000;
     }
+    logger() << "Warmup done in " << warmup_time << " [sec]" << std::endl;
+    stats_line()("type", index_type)("pages", file.mode())(
+        "load_time", file.load_time())("warmup", warmup)(
+        "warmup_time", warmup_time)("warmup_threads", threads);
 
     wand_data<> wdata;
     boost::iostreams::mapped_file_source md;
     if (wand_data_filename) {
         logger() << "Loading wand data" << std::endl;
         md.open(wand_data_filename);
-        succinct::mapper::map(wdata, md, succinct::mapper::map_flags::warmup);
+        wdata.load(md, succinct::mapper::map_flags::warmup);
     }
 
     logger() << "Index type " << index_type << std::endl;
@@ -107,30 +310,159 @@ void perftest(const char* index_filename, const char* wand_data_filename,
 
     // print_selective_queries(index, queries, 0.5);
 
-    std::function<uint64_t(term_id_vec)> query_fun;
+    auto query_fun = query_function(
+        index, query_type, k, wand_data_filename ? &wdata : nullptr, impacts);
+    if (!query_fun) return;
+    double avg = op_perftest(query_fun, queries, index_type, query_type, file,
+                             num_runs);
 
-    if (query_type == "and") {
-        query_fun = [&](term_id_vec query) {
-            return and_query()(index, query);
+    if (trace_plans and query_type == "adaptive_and") {
+        logger() << "Tracing the intersection plans" << std::endl;
+        adaptive_and_query adaptive;
+        std::map<std::string, uint64_t> strategies;
+        for (auto const& query : queries) {
+            uint64_t results = adaptive(index, query);
+            auto const& plan = adaptive.plan();
+            const char* strategy = strategy_name(plan.strategy);
+            ++strategies[strategy];
+            stats_line()("type", index_type)("query", query_type)(
+                "terms", query)("sizes", plan.sizes)(
+                "partitions", plan.partitions)("strategy", strategy)(
+                "results", results);
+        }
+        for (auto const& s : strategies) {
+            logger() << s.first << ": " << s.second << " queries"
+                     << std::endl;
+        }
+        stats_line()("type", index_type)("query", query_type)(
+            "strategies", strategies);
+    }
+
+    if (pairs_filename and query_type == "and") {
+        logger() << "Performing and queries with the pair intersections of "
+                 << pairs_filename << std::endl;
+        pair_index<IndexType> pairs;
+        boost::iostreams::mapped_file_source mp(pairs_filename);
+        succinct::mapper::map(pairs, mp);
+        pair_and_query<IndexType> pair_query(pairs);
+        auto pair_fun = [&](term_id_vec query) {
+            return pair_query(index, query);
         };
-    } else if (query_type == "ranked_and") {
-        if (wand_data_filename) {
-            logger() << "top-" << k << " results" << std::endl;
-            query_fun = [&](term_id_vec query) {
-                return ranked_and_query(wdata, k)(index, query);
-            };
-        } else {
-            logger()
-                << "You must provide wand data to perform ranked_and queries."
-                << std::endl;
-            return;
+        double pairs_avg = op_perftest(pair_fun, queries, index_type,
+                                       "and_pairs", file, num_runs);
+
+        // the queries rewritten with a pair, with and without it
+        std::vector<term_id_vec> hits;
+        for (auto const& query : queries) {
+            if (pair_query.pairs_used(index, query)) {
+                hits.push_back(query);
+            }
         }
-    } else {
-        logger() << "Unsupported query type: " << query_type << std::endl;
-        return;
+        double hits_avg = 0, hits_pairs_avg = 0;
+        if (!hits.empty()) {
+            hits_avg = op_perftest(query_fun, hits, index_type,
+                                   "and_pair_hits_plain", file, num_runs);
+            hits_pairs_avg = op_perftest(pair_fun, hits, index_type,
+                                         "and_pair_hits", file, num_runs);
+        }
+        uint64_t pairs_bytes = succinct::mapper::size_of(pairs);
+        uint64_t index_bytes = succinct::mapper::size_of(index);
+        logger() << hits.size() << " queries use a pair, mean "
+                 << hits_pairs_avg << " [ms] instead of " << hits_avg
+                 << " [ms]; pairs take " << pairs_bytes << " bytes ("
+                 << 100.0 * pairs_bytes / index_bytes << "% of the index)"
+                 << std::endl;
+        stats_line()("type", index_type)("query", query_type)(
+            "pairs", pairs.size())("pairs_bytes", pairs_bytes)(
+            "index_bytes", index_bytes)("pair_queries", hits.size())(
+            "avg", avg)("pairs_avg", pairs_avg)("pair_queries_avg", hits_avg)(
+            "pair_queries_pairs_avg", hits_pairs_avg);
+    }
+
+    // the batches and the result cache support the and and ranked_and
+    // queries only
+    bool and_or_ranked_and =
+        query_type == "and" or query_type == "ranked_and";
+    if (batch_size and !impacts and and_or_ranked_and) {
+        logger() << "Replaying the " << query_type << " queries in batches of "
+                 << batch_size << std::endl;
+        // lists opened by the queries, and by the batches
+        uint64_t query_lists = 0, batch_lists = 0;
+        for (size_t begin = 0; begin < queries.size(); begin += batch_size) {
+            std::unordered_set<term_id_type> batch_terms;
+            for (size_t q = begin;
+                 q < std::min<size_t>(begin + batch_size, queries.size());
+                 ++q) {
+                term_id_vec terms = queries[q];
+                remove_duplicate_terms(terms);
+                query_lists += terms.size();
+                batch_terms.insert(terms.begin(), terms.end());
+            }
+            batch_lists += batch_terms.size();
+        }
+        double qps = replay(query_fun, queries);
+        double batch_qps =
+            batch_replay(index, queries, query_type, wdata, k, batch_size);
+        logger() << batch_lists << " lists opened instead of " << query_lists
+                 << ", " << batch_qps << " queries/sec (" << qps
+                 << " one at a time)" << std::endl;
+        stats_line()("type", index_type)("query", query_type)(
+            "batch_size", batch_size)("query_lists", query_lists)(
+            "batch_lists", batch_lists)("qps", qps)("batch_qps", batch_qps);
     }
 
-    op_perftest(query_fun, queries, index_type, query_type, num_runs);
+    // the same queries on the decoded lists of the frequent terms
+    if (cache_mb) {
+        logger() << "Performing " << query_type << " queries with a "
+                 << cache_mb << " MB " << cache_policy << " list cache"
+                 << std::endl;
+        typename list_cache<IndexType>::parameters cache_params;
+        cache_params.budget_bytes = cache_mb << 20;
+        if (cache_policy == "lru") {
+            cache_params.eviction = list_cache<IndexType>::policy::lru;
+        }
+        list_cache<IndexType> cache(index, cache_params);
+        double cached_avg = op_perftest(
+            query_function(cache, query_type, k,
+                           wand_data_filename ? &wdata : nullptr, impacts),
+            queries, index_type, query_type + "_cached", file, num_runs);
+        auto stats = cache.stats();
+        logger() << "Cache hit rate: " << stats.hit_rate() * 100
+                 << "%, mean: " << cached_avg << " [ms] ("
+                 << avg / cached_avg << "x)" << std::endl;
+        stats_line()("type", index_type)("query", query_type)(
+            "cache_budget", cache_params.budget_bytes)(
+            "cache_policy", cache_policy)("cache_hits", stats.hits)(
+            "cache_misses", stats.misses)("cache_hit_rate", stats.hit_rate())(
+            "cache_admissions", stats.admissions)(
+            "cache_evictions", stats.evictions)("cache_bytes", stats.bytes)(
+            "cache_decode_time", stats.decode_time)("avg", avg)(
+            "cached_avg", cached_avg);
+    }
+
+    if (result_cache_entries and and_or_ranked_and) {
+        logger() << "Replaying the " << query_type << " queries with a "
+                 << result_cache_entries << " entries result cache"
+                 << std::endl;
+        double qps = replay(query_fun, queries);
+        result_cache<uint64_t> counts(result_cache_entries);
+        result_cache<topk_type> topks(result_cache_entries);
+        double cached_qps = replay(
+            cached_query_function(index, query_type, k, &wdata, impacts,
+                                  counts, topks),
+            queries);
+        auto stats = query_type == "and" ? counts.stats() : topks.stats();
+        logger() << "Result cache hit ratio: " << stats.hit_ratio() * 100
+                 << "%, " << cached_qps << " queries/sec (" << qps
+                 << " without the cache)" << std::endl;
+        stats_line()("type", index_type)("query", query_type)(
+            "result_cache_entries", result_cache_entries)(
+            "result_cache_hits", stats.hits)(
+            "result_cache_misses", stats.misses)(
+            "result_cache_hit_ratio", stats.hit_ratio())(
+            "result_cache_evictions", stats.evictions)("qps", qps)(
+            "cached_qps", cached_qps);
+    }
 }
 
 int main(int argc, const char** argv) {
@@ -138,7 +470,11 @@ int main(int argc, const char** argv) {
         std::cerr << "Usage: " << argv[0] << ":\n"
                   << "\t <index_type> <query_algorithm> <index_filename> "
                      "<query_filename>"
-                  << " [--wand wand_filename]" << std::endl;
+                  << " [--wand wand_filename] [--k k] [--hugepages]"
+                  << " [--warmup queries|full|none] [--impacts]"
+                  << " [--cache-mb mb] [--cache-policy lru|lfu]"
+                  << " [--result-cache entries] [--pairs pairs_filename]"
+                  << " [--batch batch_size] [--trace-plans]" << std::endl;
         return 1;
     }
 
@@ -150,6 +486,15 @@ int main(int argc, const char** argv) {
     configuration conf(64);
     uint64_t k = conf.k;
     const char* wand_data_filename = nullptr;
+    bool hugepages = false;
+    std::string warmup = "queries";
+    bool impacts = false;
+    uint64_t cache_mb = 0;
+    std::string cache_policy = "lfu";
+    uint64_t result_cache_entries = 0;
+    const char* pairs_filename = nullptr;
+    uint64_t batch_size = 0;
+    bool trace_plans = false;
 
     for (int i = 5; i < argc; ++i) {
         std::string arg = argv[i];
@@ -161,6 +506,54 @@ int main(int argc, const char** argv) {
         if (arg == "--k") {
             k = std::stoull(argv[++i]);
         }
+
+        if (arg == "--hugepages") {
+            hugepages = true;
+        }
+
+        if (arg == "--warmup") {
+            warmup = argv[++i];
+        }
+
+        if (arg == "--impacts") {
+            impacts = true;
+        }
+
+        if (arg == "--cache-mb") {
+            cache_mb = std::stoull(argv[++i]);
+        }
+
+        if (arg == "--cache-policy") {
+            cache_policy = argv[++i];
+        }
+
+        if (arg == "--result-cache") {
+            result_cache_entries = std::stoull(argv[++i]);
+        }
+
+        if (arg == "--pairs") {
+            pairs_filename = argv[++i];
+        }
+
+        if (arg == "--batch") {
+            batch_size = std::stoull(argv[++i]);
+        }
+
+        if (arg == "--trace-plans") {
+            trace_plans = true;
+        }
+    }
+
+    if (warmup != "queries" and warmup != "full" and warmup != "none") {
+        logger() << "ERROR: Unknown warmup mode '" << warmup << "'."
+                 << std::endl;
+        return 1;
+    }
+
+    if (cache_policy != "lru" and cache_policy != "lfu") {
+        logger() << "ERROR: Unknown cache policy '" << cache_policy << "'."
+                 << std::endl;
+        return 1;
     }
 
     std::vector<term_id_vec> queries;
@@ -181,7 +574,13 @@ int main(int argc, const char** argv) {
     }                                                                         \
     else if (index_type == BOOST_PP_STRINGIZE(T)) {                           \
         perftest<BOOST_PP_CAT(T, _index)>(index_filename, wand_data_filename, \
-                                          queries, index_type, query_type, k);
+                                          queries, index_type, query_type, k, \
+                                          hugepages, warmup,                  \
+                                          conf.worker_threads, impacts,       \
+                                          cache_mb, cache_policy,             \
+                                          result_cache_entries,               \
+                                          pairs_filename, batch_size,         \
+                                          trace_plans);
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_INDEX_TYPES);
 #undef LOOP_BODY
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "binary_collection.hpp"
+#include "binary_freq_collection.hpp"
+#include "configuration.hpp"
+#include "graph_bisection.hpp"
+#include "types.hpp"
+#include "util.hpp"
+
+using namespace pvb;
+
+struct docs_stats {
+    docs_stats() : postings(0), log_gap_bits(0), opt_vb_bits(0) {}
+    uint64_t postings;
+    double log_gap_bits;
+    uint64_t opt_vb_bits;
+};
+
+// space of the docids of a collection: the log2 of the gaps, as estimated by
+// graph bisection, and the size of the docs sequences of an opt_vb index
+docs_stats compute_docs_stats(binary_freq_collection const& coll,
+                              configuration const& conf) {
+    typedef partitioned_vb_sequence<maskedvbyte_block<>> sequence_type;
+    global_parameters params;
+    docs_stats stats;
+    for (auto const& plist : coll) {
+        uint64_t n = plist.docs.size();
+        uint64_t prev = 0;
+        for (auto doc : plist.docs) {
+            stats.log_gap_bits += std::log2(double(doc - prev + 1));
+            prev = doc + 1;
+        }
+        succinct::bit_vector_builder bvb;
+        sequence_type::write(bvb, plist.docs.begin(), coll.num_docs(), n,
+                             params, conf);
+        stats.opt_vb_bits += bvb.size();
+        stats.postings += n;
+    }
+    return stats;
+}
+
+void log_docs_stats(docs_stats const& stats, std::string const& order) {
+    double log_gap_bpi = stats.log_gap_bits / stats.postings;
+    double opt_vb_bpi = double(stats.opt_vb_bits) / stats.postings;
+    logger() << order << " order: " << log_gap_bpi << " [bpi] log-gap, "
+             << opt_vb_bpi << " [bpi] opt_vb docs" << std::endl;
+    stats_line()("order", order)("postings", stats.postings)(
+        "log_gap_bpi", log_gap_bpi)("opt_vb_docs_bpi", opt_vb_bpi);
+}
+
+void write_sequence(std::ofstream& out, uint32_t const* begin,
+                    uint32_t const* end) {
+    uint32_t n = end - begin;
+    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char*>(begin), n * sizeof(*begin));
+}
+
+void write_reordered(binary_freq_collection const& input,
+                     std::string const& input_basename,
+                     std::vector<uint32_t> const& new_ids,
+                     std::string const& output_basename) {
+    std::ofstream docs_out(output_basename + ".docs", std::ios::binary);
+    std::ofstream freqs_out(output_basename + ".freqs", std::ios::binary);
+    uint32_t header[] = {uint32_t(input.num_docs())};
+    write_sequence(docs_out, header, header + 1);
+
+    std::vector<std::pair<uint32_t, uint32_t>> postings;
+    std::vector<uint32_t> docs, freqs;
+    for (auto const& plist : input) {
+        uint64_t n = plist.docs.size();
+        postings.resize(n);
+        for (uint64_t i = 0; i < n; ++i) {
+            postings[i] = {new_ids[plist.docs.begin()[i]],
+                           plist.freqs.begin()[i]};
+        }
+        std::sort(postings.begin(), postings.end());
+        docs.resize(n);
+        freqs.resize(n);
+        for (uint64_t i = 0; i < n; ++i) {
+            docs[i] = postings[i].first;
+            freqs[i] = postings[i].second;
+        }
+        write_sequence(docs_out, docs.data(), docs.data() + n);
+        write_sequence(freqs_out, freqs.data(), freqs.data() + n);
+    }
+
+    std::ifstream sizes_file(input_basename + ".sizes");
+    if (sizes_file.good()) {
+        binary_collection sizes_coll((input_basename + ".sizes").c_str());
+        auto sizes = *sizes_coll.begin();
+        if (sizes.size() != new_ids.size()) {
+            throw std::runtime_error("Sizes do not match the collection");
+        }
+        std::vector<uint32_t> new_sizes(sizes.size());
+        for (uint64_t i = 0; i < sizes.size(); ++i) {
+            new_sizes[new_ids[i]] = sizes.begin()[i];
+        }
+        std::ofstream sizes_out(output_basename + ".sizes", std::ios::binary);
+        write_sequence(sizes_out, new_sizes.data(),
+                       new_sizes.data() + new_sizes.size());
+    } else {
+        logger() << "No " << input_basename << ".sizes, skipping"
+                 << std::endl;
+    }
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage " << argv[0] << ":\n\t"
+                  << "<collection_basename> <output_basename> [--min-len l] "
+                     "[--depth d] [--iterations i]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string input_basename = argv[1];
+    std::string output_basename = argv[2];
+
+    configuration conf(64);
+    graph_bisection::parameters params;
+    params.threads = conf.worker_threads;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--min-len") {
+            params.min_list_length = std::stoull(argv[++i]);
+        } else if (arg == "--depth") {
+            params.max_depth = std::stoull(argv[++i]);
+        } else if (arg == "--iterations") {
+            params.iterations = std::stoull(argv[++i]);
+        } else {
+            logger() << "ERROR: Unknown option '" << arg << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    binary_freq_collection input(input_basename.c_str());
+    log_docs_stats(compute_docs_stats(input, conf), "original");
+
+    logger() << "Building forward index" << std::endl;
+    double tick = get_time_usecs();
+    graph_bisection bp(input, params);
+    logger() << bp.num_terms() << " terms, " << bp.num_edges() << " postings"
+             << std::endl;
+
+    logger() << "Computing the permutation with " << params.threads
+             << " threads" << std::endl;
+    auto new_ids = bp.compute_permutation();
+    double elapsed_secs = (get_time_usecs() - tick) / 1000000;
+    logger() << "Permutation computed in " << elapsed_secs << " seconds"
+             << std::endl;
+
+    logger() << "Writing " << output_basename << std::endl;
+    write_reordered(input, input_basename, new_ids, output_basename);
+
+    binary_freq_collection output(output_basename.c_str());
+    log_docs_stats(compute_docs_stats(output, conf), "reordered");
+    stats_line()("reordering_time", elapsed_secs)(
+        "worker_threads", params.threads);
+}
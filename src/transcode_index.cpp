@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "succinct/mapper.hpp"
+
+#include "configuration.hpp"
+#include "index_build_utils.hpp"
+#include "types.hpp"
+#include "util.hpp"
+
+using namespace pvb;
+
+// decoded lists [begin, end) of the input index; list i - begin is
+// [offsets[i - begin], offsets[i - begin + 1]) of docs and freqs
+struct posting_batch {
+    uint64_t begin;
+    uint64_t end;
+    std::vector<uint64_t> offsets;
+    std::vector<uint64_t> occurrences;
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> freqs;
+};
+
+// the input index, seen through the lists it returns, so that the input and
+// output types are dispatched independently
+struct list_source {
+    uint64_t num_docs;
+    uint64_t size;
+    std::function<uint64_t(uint64_t)> list_size;
+    std::function<void(uint64_t, uint32_t*, uint32_t*)> decode;
+};
+
+template <typename Index>
+list_source make_source(Index& index) {
+    list_source source;
+    source.num_docs = index.num_docs();
+    source.size = index.size();
+    source.list_size = [&index](uint64_t i) { return index[i].size(); };
+    source.decode = [&index](uint64_t i, uint32_t* docs, uint32_t* freqs) {
+        auto e = index[i];
+        for (uint64_t j = 0; j < e.size(); ++j, e.next()) {
+            docs[j] = e.docid();
+            freqs[j] = e.freq();
+        }
+    };
+    return source;
+}
+
+// Fills batch with the lists from begin on, up to max_postings postings (at
+// least one list), decoded by threads threads.
+void read_batch(list_source const& source, uint64_t begin,
+                uint64_t max_postings, size_t threads, posting_batch& batch) {
+    batch.begin = begin;
+    batch.offsets.assign(1, 0);
+    uint64_t end = begin;
+    while (end < source.size) {
+        uint64_t n = source.list_size(end);
+        if (end > begin and batch.offsets.back() + n > max_postings) break;
+        batch.offsets.push_back(batch.offsets.back() + n);
+        ++end;
+    }
+    batch.end = end;
+    batch.docs.resize(batch.offsets.back());
+    batch.freqs.resize(batch.offsets.back());
+    batch.occurrences.assign(end - begin, 0);
+    threads = std::max<size_t>(threads, 1);
+
+    // lists are taken in turn, to balance the long and the short ones
+    auto decode = [&](size_t t) {
+        for (uint64_t i = begin + t; i < end; i += threads) {
+            uint64_t offset = batch.offsets[i - begin];
+            uint64_t n = batch.offsets[i - begin + 1] - offset;
+            uint32_t* freqs = batch.freqs.data() + offset;
+            source.decode(i, batch.docs.data() + offset, freqs);
+            batch.occurrences[i - begin] =
+                std::accumulate(freqs, freqs + n, uint64_t(0));
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(decode, t);
+    }
+    decode(0);
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+// The lists are decoded in batches of bounded size: while the builder encodes
+// a batch, the next one is decoded in the background, so at most two batches
+// are in memory at any time.
+template <typename Index>
+void transcode(list_source const& source, std::string const& type,
+               global_parameters const& params, configuration const& conf,
+               uint64_t max_postings, const char* output_filename,
+               bool check) {
+    logger() << "Transcoding " << source.size << " lists to " << type
+             << " with F = " << conf.fix_cost << std::endl;
+    double tick = get_time_usecs();
+
+    typename Index::builder builder(source.num_docs, params);
+    progress_logger plog;
+    uint64_t batches = 0;
+    posting_batch cur, next;
+    read_batch(source, 0, max_postings, conf.worker_threads, cur);
+    while (cur.begin < cur.end) {
+        std::thread reader([&] {
+            read_batch(source, cur.end, max_postings, conf.worker_threads,
+                       next);
+        });
+        for (uint64_t i = cur.begin; i < cur.end; ++i) {
+            uint64_t offset = cur.offsets[i - cur.begin];
+            uint64_t n = cur.offsets[i - cur.begin + 1] - offset;
+            builder.add_posting_list(n, cur.docs.data() + offset,
+                                     cur.freqs.data() + offset,
+                                     cur.occurrences[i - cur.begin], conf);
+            plog.done_sequence(n);
+        }
+        reader.join();
+        std::swap(cur, next);
+        ++batches;
+    }
+
+    plog.log();
+    Index coll;
+    builder.build(coll);
+    double elapsed_secs = (get_time_usecs() - tick) / 1000000;
+    logger() << type << " index transcoded in " << elapsed_secs
+             << " seconds, " << batches << " batches" << std::endl;
+    stats_line()("type", type)("worker_threads", conf.worker_threads)(
+        "batches", batches)("max_batch_postings", max_postings)(
+        "transcoding_time", elapsed_secs);
+
+    dump_stats(coll, type, plog.postings);
+
+    if (check) {
+        logger() << "Checking index..." << std::endl;
+        std::vector<uint32_t> docs, freqs;
+        for (uint64_t i = 0; i < source.size; ++i) {
+            uint64_t n = source.list_size(i);
+            docs.resize(n);
+            freqs.resize(n);
+            source.decode(i, docs.data(), freqs.data());
+            auto e = coll[i];
+            bool ok = e.size() == n;
+            for (uint64_t j = 0; ok and j < n; ++j, e.next()) {
+                ok = e.docid() == docs[j] and e.freq() == freqs[j];
+            }
+            if (!ok) {
+                logger() << "list " << i << " differs!" << std::endl;
+                exit(1);
+            }
+        }
+        logger() << "Everything is OK!" << std::endl;
+    }
+
+    if (output_filename) {
+        logger() << "Saving " << output_filename << std::endl;
+        succinct::mapper::freeze(coll, output_filename);
+    }
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage " << argv[0] << ":\n\t"
+                  << "<input_type> <input_filename> <output_type> [--out "
+                     "<output_filename>] [--F <fix_cost>] [--batch-postings "
+                     "<n>] [--check]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string input_type = argv[1];
+    const char* input_filename = argv[2];
+    std::string output_type = argv[3];
+    const char* output_filename = nullptr;
+    uint64_t F = 64;
+    uint64_t max_postings = uint64_t(1) << 24;
+    bool check = false;
+
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--out") {
+            output_filename = argv[++i];
+        } else if (arg == "--F") {
+            F = std::stoull(argv[++i]);
+        } else if (arg == "--batch-postings") {
+            max_postings = std::stoull(argv[++i]);
+        } else if (arg == "--check") {
+            check = true;
+        } else {
+            logger() << "ERROR: Unknown option '" << arg << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    // the sharded builder keeps pointers to all the lists until the end
+    if (output_type == "sharded_opt_vb") {
+        logger() << "ERROR: " << output_type
+                 << " needs the whole collection in memory, transcode to "
+                    "opt_vb instead"
+                 << std::endl;
+        return 1;
+    }
+
+    configuration conf(F);
+    global_parameters params;
+    params.log_partition_size = conf.log_partition_size;
+
+    boost::iostreams::mapped_file_source m(input_filename);
+    std::function<void(list_source const&)> run;
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                              \
+    }                                                                      \
+    else if (output_type == BOOST_PP_STRINGIZE(T)) {                       \
+        run = [&](list_source const& source) {                             \
+            transcode<BOOST_PP_CAT(T, _index)>(source, output_type, params, \
+                                               conf, max_postings,          \
+                                               output_filename, check);     \
+        };
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown type " << output_type << std::endl;
+        return 1;
+    }
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                               \
+    }                                                       \
+    else if (input_type == BOOST_PP_STRINGIZE(T)) {         \
+        BOOST_PP_CAT(T, _index) index;                      \
+        succinct::mapper::map(index, m);                    \
+        run(make_source(index));
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, DS2I_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown type " << input_type << std::endl;
+        return 1;
+    }
+
+    return 0;
+}